@@ -24,10 +24,13 @@
 #include <cmath>
 #include <vector>
 #include <list>
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <chrono>
 #include <cstring>
+#include <cfloat>
+#include <atomic>
 #include <thorvg-1/thorvg.h>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_syswm.h>
@@ -61,21 +64,267 @@ using namespace tvg;
 /* Common Template Code                                                 */
 /************************************************************************/
 
+#ifdef TVGDEMO_PROFILE
+
+//C++ heap allocations, reported per frame by the profiler. The engine threads allocate too.
+//The aligned operator new(size_t, std::align_val_t) is not replaced, so over-aligned allocations are not counted.
+namespace tvgdemo { std::atomic<uint64_t> allocations{0}; }
+
+void* operator new(size_t size)
+{
+    tvgdemo::allocations.fetch_add(1, std::memory_order_relaxed);
+    if (auto p = malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+#endif
+
 namespace tvgdemo
 {
 
 bool verify(tvg::Result result, string failMsg = "");
 
+//run options shared by the window and the demo
+struct Options
+{
+    uint32_t step = 0;      //fixed simulation step in ms (0: follow the real clock)
+    uint32_t seed = 1;      //seed for the demo random generator
+    const char* record = nullptr;   //input recording path
+    const char* replay = nullptr;   //input replay path
+    const char* csv = "profile.csv";    //profiler export path
+    const char* trace = nullptr;        //trace-event export path
+    bool crosscheck = false;            //verify optimized paths against the reference ones
+    uint32_t missiles = 0;              //projectile capacity (0: demo default)
+    uint32_t spread = 1;                //projectiles per shot
+    uint32_t target = 0;                //frame rate the demo adapts its quality to (0: off)
+    bool bake = false;                  //pre-render the static content
+    bool atlas = false;                 //draw the enemies from pre-rotated images
+};
+
+Options options;
+
+
+/************************************************************************/
+/* Frame Profiler                                                       */
+/************************************************************************/
+
+#ifdef TVGDEMO_PROFILE
+
+//Accumulates the time spent in named phases per frame. Build with -DTVGDEMO_PROFILE.
+struct Profiler
+{
+    static constexpr const int MAX_PHASES = 16;
+
+    const char* names[MAX_PHASES];
+    double current[MAX_PHASES] = {};    //accumulated time (ms) of the frame in progress
+    double last[MAX_PHASES] = {};       //time (ms) of the last completed frame
+    double average[MAX_PHASES] = {};    //smoothed time (ms) for the display
+    double frameTime = 0.0;             //wall time (ms) of the last completed frame
+    uint64_t allocs = 0;                //heap allocations of the last completed frame
+    uint64_t allocMark = 0;
+    uint32_t transforms = 0;            //paint transform updates of the last completed frame
+    uint32_t transformCnt = 0;          //paint transform updates of the frame in progress
+    vector<float> rows;                 //per-frame samples for the csv export
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    int count = 0;
+
+    int reg(const char* name)
+    {
+        if (count == MAX_PHASES) return MAX_PHASES - 1;
+        names[count] = name;
+        return count++;
+    }
+
+    void frame()
+    {
+        auto now = std::chrono::steady_clock::now();
+        frameTime = std::chrono::duration<double, std::milli>(now - begin).count();
+        begin = now;
+        auto count = allocations.load(std::memory_order_relaxed);
+        allocs = count - allocMark;
+
+        rows.push_back(float(frameTime));
+        rows.push_back(float(allocs));
+        rows.push_back(float(transformCnt));
+        transforms = transformCnt;
+        transformCnt = 0;
+        for (int i = 0; i < MAX_PHASES; ++i) {
+            last[i] = current[i];
+            average[i] += 0.1 * (current[i] - average[i]);
+            rows.push_back(float(current[i]));
+            current[i] = 0.0;
+        }
+        allocMark = count;
+    }
+
+    void save(const char* path)
+    {
+        ofstream file(path);
+        if (!file) return;
+
+        file << "frame,total,allocs,transforms";
+        for (int i = 0; i < count; ++i) file << "," << names[i];
+        file << "\n";
+
+        auto stride = MAX_PHASES + 3;
+        for (size_t r = 0; r + stride <= rows.size(); r += stride) {
+            file << r / stride;
+            for (int i = 0; i < count + 3; ++i) file << "," << rows[r + i];
+            file << "\n";
+        }
+        cout << "Profile written: " << path << " (" << rows.size() / stride << " frames)" << endl;
+    }
+};
+
+Profiler profiler;
+
+//Chrome trace-event recorder. Events go to a preallocated ring and are serialized only on save().
+struct Tracer
+{
+    struct Event
+    {
+        const char* name;
+        double ts, dur;     //microseconds
+        char ph;            //'X': complete, 'i': instant
+    };
+
+    vector<Event> ring;
+    std::chrono::steady_clock::time_point origin;
+    const char* path = nullptr;
+    size_t head = 0;
+    bool wrapped = false;
+    bool active = false;
+
+    void enable(const char* path, size_t capacity = 1 << 18)
+    {
+        this->path = path;
+        ring.resize(capacity);
+        origin = std::chrono::steady_clock::now();
+        active = true;
+    }
+
+    double usec(std::chrono::steady_clock::time_point t)
+    {
+        return std::chrono::duration<double, std::micro>(t - origin).count();
+    }
+
+    void push(const char* name, double ts, double dur, char ph)
+    {
+        ring[head] = {name, ts, dur, ph};
+        if (++head == ring.size()) {
+            head = 0;
+            wrapped = true;
+        }
+    }
+
+    void span(const char* name, std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end)
+    {
+        if (active) push(name, usec(begin), usec(end) - usec(begin), 'X');
+    }
+
+    void instant(const char* name)
+    {
+        if (active) push(name, usec(std::chrono::steady_clock::now()), 0.0, 'i');
+    }
+
+    void save()
+    {
+        if (!active) return;
+
+        ofstream file(path);
+        if (!file) return;
+
+        file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+        //oldest first
+        auto cnt = wrapped ? ring.size() : head;
+        auto idx = wrapped ? head : 0;
+        char buf[256];
+        for (size_t i = 0; i < cnt; ++i, idx = (idx + 1) % ring.size()) {
+            auto& e = ring[idx];
+            if (e.ph == 'X') snprintf(buf, sizeof(buf), "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":1}", i ? "," : "", e.name, e.ts, e.dur);
+            else snprintf(buf, sizeof(buf), "%s\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":1,\"tid\":1}", i ? "," : "", e.name, e.ts);
+            file << buf;
+        }
+        file << "\n]}\n";
+        cout << "Trace written: " << path << " (" << cnt << " events)" << endl;
+    }
+};
+
+Tracer tracer;
+
+struct ProfileScope
+{
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    int id;
+
+    ProfileScope(int id) : id(id) {}
+
+    ~ProfileScope()
+    {
+        auto end = std::chrono::steady_clock::now();
+        profiler.current[id] += std::chrono::duration<double, std::milli>(end - begin).count();
+        tracer.span(profiler.names[id], begin, end);
+    }
+};
+
+//trace only span, not accumulated by the profiler
+struct TraceScope
+{
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    const char* name;
+
+    TraceScope(const char* name) : name(name) {}
+
+    ~TraceScope()
+    {
+        tracer.span(name, begin, std::chrono::steady_clock::now());
+    }
+};
+
+#define PROFILE_CONCAT2(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+#define PROFILE_SCOPE(name) \
+    static const int PROFILE_CONCAT(_profileId, __LINE__) = tvgdemo::profiler.reg(name); \
+    tvgdemo::ProfileScope PROFILE_CONCAT(_profileScope, __LINE__)(PROFILE_CONCAT(_profileId, __LINE__))
+#define PROFILE_FRAME() tvgdemo::profiler.frame()
+#define PROFILE_TRANSFORMS(n) tvgdemo::profiler.transformCnt += (n)
+#define TRACE_SCOPE(name) tvgdemo::TraceScope PROFILE_CONCAT(_traceScope, __LINE__)(name)
+#define TRACE_EVENT(name) tvgdemo::tracer.instant(name)
+
+#else
+
+#define PROFILE_SCOPE(name)
+#define PROFILE_FRAME()
+#define PROFILE_TRANSFORMS(n)
+#define TRACE_SCOPE(name)
+#define TRACE_EVENT(name)
+
+#endif
+
 struct Demo
 {
     uint32_t elapsed = 0;
     uint32_t fps;
+    float busy = 0.0f;      //wall time (ms) of the last update and draw, without the presentation
+    bool quit = false;      //request to terminate the main loop
 
     virtual bool content(tvg::Canvas* canvas, uint32_t w, uint32_t h) = 0;
     virtual bool update(tvg::Canvas* canvas, uint32_t elapsed) { return false; }
     virtual bool clickdown(tvg::Canvas* canvas, int32_t x, int32_t y) { return false; }
     virtual bool clickup(tvg::Canvas* canvas, int32_t x, int32_t y) { return false; }
     virtual bool motion(tvg::Canvas* canvas, int32_t x, int32_t y) { return false; }
+    virtual void resize(tvg::Canvas* canvas, uint32_t w, uint32_t h) {}
     virtual void populate(const char* path) {}
     virtual ~Demo() {}
 
@@ -206,12 +455,15 @@ struct Window
     bool draw()
     {
         //Draw the contents to the Canvas
-        if (verify(canvas->draw(clearBuffer))) {
+        {
+            PROFILE_SCOPE("draw");
+            if (!verify(canvas->draw(clearBuffer))) return false;
+        }
+        {
+            PROFILE_SCOPE("sync");
             verify(canvas->sync());
-            return true;
         }
-
-        return false;
+        return true;
     }
 
     bool ready()
@@ -227,7 +479,7 @@ struct Window
         return true;
     }
 
-    void show()
+    virtual void show()
     {
         SDL_ShowWindow(window);
         refresh();
@@ -240,7 +492,9 @@ struct Window
         demo->elapsed = 0;
         uint32_t tickCnt = 0;
 
-        while (running) {
+        while (running && !demo->quit) {
+
+            TRACE_SCOPE("frame");
 
             //SDL Event handling
             while (SDL_PollEvent(&event)) {
@@ -251,6 +505,9 @@ struct Window
                     }
                     case SDL_KEYDOWN: {
                         if (event.key.keysym.sym == SDLK_ESCAPE) running = false;
+                    #ifdef TVGDEMO_PROFILE
+                        if (event.key.keysym.sym == SDLK_F9) tracer.save();
+                    #endif
                         break;
                     }
                     case SDL_MOUSEBUTTONDOWN: {
@@ -278,24 +535,35 @@ struct Window
 
             if (needResize) {
                 resize();
+                demo->resize(canvas, width, height);
                 needResize = false;
             }
 
+            auto begin = std::chrono::steady_clock::now();
+
             if (tickCnt > 0) {
+                TRACE_SCOPE("update");
                 needDraw |= demo->update(canvas, demo->elapsed);
             }
 
             if (needDraw) {
-                if (draw()) refresh();
+                auto ret = draw();
+                demo->busy = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - begin).count();
+                if (ret) {
+                    PROFILE_SCOPE("refresh");
+                    refresh();
+                }
                 needDraw = false;
             }
 
             auto ctime = SDL_GetTicks();
-            demo->elapsed += (ctime - ptime);
+            demo->elapsed += options.step ? options.step : (ctime - ptime);
             tickCnt++;
             ptime = ctime;
 
             demo->fps = fps();
+
+            PROFILE_FRAME();
         }
     }
 
@@ -341,6 +609,138 @@ struct SwWindow : Window
     }
 };
 
+/************************************************************************/
+/* Headless Window Code                                                 */
+/************************************************************************/
+
+struct HeadlessWindow : Window
+{
+    uint32_t* buffer = nullptr;
+    uint32_t frames;
+
+    HeadlessWindow(Demo* demo, uint32_t width, uint32_t height, uint32_t threadsCnt, uint32_t frames) : Window(demo, width, height, threadsCnt), frames(frames)
+    {
+        if (!initialized) return;
+
+        //No window surface, render into a plain heap buffer instead.
+        buffer = (uint32_t*)malloc(width * height * sizeof(uint32_t));
+
+        //Create a Canvas
+        canvas = tvg::SwCanvas::gen(tvg::EngineOption(0));
+        if (!canvas) {
+            cout << "SwCanvas is not supported. Did you enable the SwEngine?" << endl;
+            return;
+        }
+
+        resize();
+    }
+
+    virtual ~HeadlessWindow()
+    {
+        //Free in the reverse order of their creation.
+        delete(canvas);
+        canvas = nullptr;
+
+        free(buffer);
+    }
+
+    void resize() override
+    {
+        verify(static_cast<tvg::SwCanvas*>(canvas)->target(buffer, width, width, height, tvg::ColorSpace::ARGB8888));
+    }
+
+    static double msec(std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end)
+    {
+        return std::chrono::duration<double, std::milli>(end - begin).count();
+    }
+
+    static void report(const char* name, vector<double>& samples)
+    {
+        if (samples.empty()) return;
+
+        std::sort(samples.begin(), samples.end());
+
+        auto sum = 0.0;
+        for (auto s : samples) sum += s;
+
+        //nearest-rank percentile
+        auto percentile = [&](double p) {
+            auto idx = size_t(ceil(p * samples.size()));
+            return samples[idx > 0 ? idx - 1 : 0];
+        };
+
+        printf("%-8s %9.3f %9.3f %9.3f %9.3f %9.3f\n", name, sum / samples.size(), percentile(0.5), percentile(0.95), percentile(0.99), samples.back());
+    }
+
+    //run the demo for a fixed number of frames as fast as possible
+    void show() override
+    {
+        using clock = std::chrono::steady_clock;
+
+        vector<double> update, draw, sync, total, allocs, xforms;
+        update.reserve(frames);
+        draw.reserve(frames);
+        sync.reserve(frames);
+        total.reserve(frames);
+
+        auto ptime = SDL_GetTicks();
+        demo->elapsed = 0;
+
+        for (uint32_t i = 0; i < frames && !demo->quit; ++i) {
+            TRACE_SCOPE("frame");
+
+            auto t0 = clock::now();
+            if (i > 0) {
+                TRACE_SCOPE("update");
+                demo->update(canvas, demo->elapsed);
+            }
+            auto t1 = clock::now();
+            {
+                PROFILE_SCOPE("draw");
+                verify(canvas->draw(clearBuffer));
+            }
+            auto t2 = clock::now();
+            {
+                PROFILE_SCOPE("sync");
+                verify(canvas->sync());
+            }
+            auto t3 = clock::now();
+
+            update.push_back(msec(t0, t1));
+            draw.push_back(msec(t1, t2));
+            sync.push_back(msec(t2, t3));
+            total.push_back(msec(t0, t3));
+            demo->busy = float(total.back());
+
+            auto ctime = SDL_GetTicks();
+            demo->elapsed += options.step ? options.step : (ctime - ptime);
+            ptime = ctime;
+
+            demo->fps = fps();
+
+            PROFILE_FRAME();
+        #ifdef TVGDEMO_PROFILE
+            allocs.push_back(double(profiler.allocs));
+            xforms.push_back(double(profiler.transforms));
+        #endif
+        }
+
+        printf("Headless run: %zu frames, %ux%u, %u ms simulated\n", total.size(), width, height, demo->elapsed);
+        printf("%-8s %9s %9s %9s %9s %9s\n", "(ms)", "mean", "p50", "p95", "p99", "max");
+        report("update", update);
+        report("draw", draw);
+        report("sync", sync);
+        report("total", total);
+
+        //counts per frame, profiler build only
+        if (!allocs.empty()) {
+            printf("%-8s %9s %9s %9s %9s %9s\n", "(count)", "mean", "p50", "p95", "p99", "max");
+            report("allocs", allocs);
+            report("xforms", xforms);
+        }
+    }
+};
+
 /************************************************************************/
 /* GlCanvas Window Code                                                 */
 /************************************************************************/
@@ -567,16 +967,56 @@ bool verify(tvg::Result result, string failMsg)
 
 int main(Demo* demo, int argc, char **argv, bool clearBuffer = false, uint32_t width = 800, uint32_t height = 800, uint32_t threadsCnt = 4, bool print = false)
 {
-    auto engine = 0; //0: sw, 1: gl, 2: wg
-
-    if (argc > 1) {
-        if (!strcmp(argv[1], "gl")) engine = 1;
-        if (!strcmp(argv[1], "wg")) engine = 2;
+    auto engine = 0; //0: sw, 1: gl, 2: wg, 3: headless sw
+    uint32_t frames = 1000;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "gl")) engine = 1;
+        else if (!strcmp(argv[i], "wg")) engine = 2;
+        else if (!strcmp(argv[i], "headless")) {
+            engine = 3;
+            if (i + 1 < argc && isdigit(argv[i + 1][0])) frames = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-fixed")) {
+            options.step = 16;
+            if (i + 1 < argc && isdigit(argv[i + 1][0])) options.step = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-seed")) {
+            if (i + 1 < argc) options.seed = strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "-record")) {
+            if (i + 1 < argc) options.record = argv[++i];
+        } else if (!strcmp(argv[i], "-replay")) {
+            if (i + 1 < argc) options.replay = argv[++i];
+        } else if (!strcmp(argv[i], "-csv")) {
+            if (i + 1 < argc) options.csv = argv[++i];
+        } else if (!strcmp(argv[i], "-trace")) {
+            if (i + 1 < argc) options.trace = argv[++i];
+        } else if (!strcmp(argv[i], "-crosscheck")) {
+            options.crosscheck = true;
+        } else if (!strcmp(argv[i], "-missiles")) {
+            if (i + 1 < argc) options.missiles = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-spread")) {
+            if (i + 1 < argc) options.spread = std::max(atoi(argv[++i]), 1);
+        } else if (!strcmp(argv[i], "-target")) {
+            if (i + 1 < argc) options.target = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-bake")) {
+            options.bake = true;
+        } else if (!strcmp(argv[i], "-atlas")) {
+            options.atlas = true;
+        }
     }
 
+    if (options.step > 0) cout << "Deterministic run: " << options.step << "ms step, seed " << options.seed << endl;
+
+#ifdef TVGDEMO_PROFILE
+    if (options.trace) tracer.enable(options.trace);
+#endif
+
     unique_ptr<Window> window;
 
-    if (engine == 0) {
+    if (engine == 3) {
+        //no display is required for the offscreen run
+        SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+        window = unique_ptr<Window>(new HeadlessWindow(demo, width, height, threadsCnt, frames));
+    } else if (engine == 0) {
         window = unique_ptr<Window>(new SwWindow(demo, width, height, threadsCnt));
     } else if (engine == 1) {
         window = unique_ptr<Window>(new GlWindow(demo, width, height, threadsCnt));
@@ -591,6 +1031,11 @@ int main(Demo* demo, int argc, char **argv, bool clearBuffer = false, uint32_t w
         window->show();
     }
 
+#ifdef TVGDEMO_PROFILE
+    profiler.save(options.csv);
+    tracer.save();
+#endif
+
     return 0;
 }
 
@@ -22,6 +22,14 @@
 #include "template.h"
 #include "assets.h"
 
+#if defined(__GNUC__) && defined(__SSE2__)
+    #include <immintrin.h>
+    #define KERNEL_X86
+#elif defined(__aarch64__)
+    #include <arm_neon.h>
+    #define KERNEL_NEON
+#endif
+
 /************************************************************************/
 /* Math Utility                                                         */
 /************************************************************************/
@@ -65,12 +73,224 @@ static void extend(Point& pt, float length) {
     pt.y *= length / mag;
 }
 
+//xorshift32, seedable replacement of rand() so that a run can be reproduced.
+static struct Random
+{
+    uint32_t state = 1;
+
+    void seed(uint32_t seed)
+    {
+        state = seed * 2654435761u + 0x9e3779b9u;
+        if (state == 0) state = 1;
+    }
+
+    int operator()()
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return int(state >> 1);     //non-negative, like rand()
+    }
+} rng;
+
+//draws of the visual only randomness, e.g. the flash colors. They depend on what is visible,
+//so they are kept out of the gameplay stream above.
+static Random flicker;
+
 template <typename T>
 static inline T lerp(const T &start, const T &end, float t)
 {
     return static_cast<T>(start + (end - start) * t);
 }
 
+#define ELLIPSE_PTS 13
+
+//ellipse outline as 4 cubic curves: MoveTo, CubicTo x 4, Close
+static void ellipse(Point* pts, float cx, float cy, float rx, float ry)
+{
+    const auto k = 0.552284f;   //cubic bezier circle approximation
+    Point p[ELLIPSE_PTS] = {
+        {cx + rx, cy},
+        {cx + rx, cy + ry * k}, {cx + rx * k, cy + ry}, {cx, cy + ry},
+        {cx - rx * k, cy + ry}, {cx - rx, cy + ry * k}, {cx - rx, cy},
+        {cx - rx, cy - ry * k}, {cx - rx * k, cy - ry}, {cx, cy - ry},
+        {cx + rx * k, cy - ry}, {cx + rx, cy - ry * k}, {cx + rx, cy}
+    };
+    memcpy(pts, p, sizeof(p));
+}
+
+static void rotate(Point* pts, size_t cnt, float degree)
+{
+    auto radian = degree / 180.0f * M_PI;
+    auto cs = cosf(radian);
+    auto sn = sinf(radian);
+    for (size_t i = 0; i < cnt; ++i) {
+        pts[i] = {pts[i].x * cs - pts[i].y * sn, pts[i].x * sn + pts[i].y * cs};
+    }
+}
+
+//O(1) removal, the last element takes the place of the removed one.
+template <typename T>
+static inline void swapRemove(vector<T>& v, size_t i)
+{
+    v[i] = v.back();
+    v.pop_back();
+}
+
+/************************************************************************/
+/* Batch Kernels                                                        */
+/************************************************************************/
+
+//Tween kernels over whole arrays. The fastest supported one is picked at runtime.
+struct Kernels
+{
+    const char* name;
+    //t[i] = (elapsed - at[i]) / duration[i]
+    void (*progress)(const uint32_t* at, const float* duration, uint32_t elapsed, float* t, size_t n);
+    //out[i] = lerp(from[i], to[i], t[i])
+    void (*lerp)(const float* from, const float* to, const float* t, float* out, size_t n);
+    //out[i] = lerp(from, to[i], t), tween from a shared origin
+    void (*tween)(float from, const float* to, float t, float* out, size_t n);
+};
+
+static void progressC(const uint32_t* at, const float* duration, uint32_t elapsed, float* t, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) t[i] = float(int32_t(elapsed - at[i])) / duration[i];
+}
+
+static void lerpC(const float* from, const float* to, const float* t, float* out, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) out[i] = lerp(from[i], to[i], t[i]);
+}
+
+static void tweenC(float from, const float* to, float t, float* out, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) out[i] = lerp(from, to[i], t);
+}
+
+#ifdef KERNEL_X86
+
+static void progressSSE2(const uint32_t* at, const float* duration, uint32_t elapsed, float* t, size_t n)
+{
+    size_t i = 0;
+    auto e = _mm_set1_epi32(int(elapsed));
+    for (; i + 4 <= n; i += 4) {
+        auto d = _mm_sub_epi32(e, _mm_loadu_si128((const __m128i*)(at + i)));
+        _mm_storeu_ps(t + i, _mm_div_ps(_mm_cvtepi32_ps(d), _mm_loadu_ps(duration + i)));
+    }
+    progressC(at + i, duration + i, elapsed, t + i, n - i);
+}
+
+static void lerpSSE2(const float* from, const float* to, const float* t, float* out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        auto f = _mm_loadu_ps(from + i);
+        _mm_storeu_ps(out + i, _mm_add_ps(f, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(to + i), f), _mm_loadu_ps(t + i))));
+    }
+    lerpC(from + i, to + i, t + i, out + i, n - i);
+}
+
+static void tweenSSE2(float from, const float* to, float t, float* out, size_t n)
+{
+    size_t i = 0;
+    auto f = _mm_set1_ps(from);
+    auto vt = _mm_set1_ps(t);
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_ps(out + i, _mm_add_ps(f, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(to + i), f), vt)));
+    }
+    tweenC(from, to + i, t, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void progressAVX2(const uint32_t* at, const float* duration, uint32_t elapsed, float* t, size_t n)
+{
+    size_t i = 0;
+    auto e = _mm256_set1_epi32(int(elapsed));
+    for (; i + 8 <= n; i += 8) {
+        auto d = _mm256_sub_epi32(e, _mm256_loadu_si256((const __m256i*)(at + i)));
+        _mm256_storeu_ps(t + i, _mm256_div_ps(_mm256_cvtepi32_ps(d), _mm256_loadu_ps(duration + i)));
+    }
+    progressC(at + i, duration + i, elapsed, t + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void lerpAVX2(const float* from, const float* to, const float* t, float* out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        auto f = _mm256_loadu_ps(from + i);
+        _mm256_storeu_ps(out + i, _mm256_add_ps(f, _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(to + i), f), _mm256_loadu_ps(t + i))));
+    }
+    lerpC(from + i, to + i, t + i, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void tweenAVX2(float from, const float* to, float t, float* out, size_t n)
+{
+    size_t i = 0;
+    auto f = _mm256_set1_ps(from);
+    auto vt = _mm256_set1_ps(t);
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(out + i, _mm256_add_ps(f, _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(to + i), f), vt)));
+    }
+    tweenC(from, to + i, t, out + i, n - i);
+}
+
+#endif
+
+#ifdef KERNEL_NEON
+
+static void progressNEON(const uint32_t* at, const float* duration, uint32_t elapsed, float* t, size_t n)
+{
+    size_t i = 0;
+    auto e = vdupq_n_s32(int32_t(elapsed));
+    for (; i + 4 <= n; i += 4) {
+        auto d = vsubq_s32(e, vreinterpretq_s32_u32(vld1q_u32(at + i)));
+        vst1q_f32(t + i, vdivq_f32(vcvtq_f32_s32(d), vld1q_f32(duration + i)));
+    }
+    progressC(at + i, duration + i, elapsed, t + i, n - i);
+}
+
+static void lerpNEON(const float* from, const float* to, const float* t, float* out, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        auto f = vld1q_f32(from + i);
+        vst1q_f32(out + i, vmlaq_f32(f, vsubq_f32(vld1q_f32(to + i), f), vld1q_f32(t + i)));
+    }
+    lerpC(from + i, to + i, t + i, out + i, n - i);
+}
+
+static void tweenNEON(float from, const float* to, float t, float* out, size_t n)
+{
+    size_t i = 0;
+    auto f = vdupq_n_f32(from);
+    auto vt = vdupq_n_f32(t);
+    for (; i + 4 <= n; i += 4) {
+        vst1q_f32(out + i, vmlaq_f32(f, vsubq_f32(vld1q_f32(to + i), f), vt));
+    }
+    tweenC(from, to + i, t, out + i, n - i);
+}
+
+#endif
+
+static const Kernels SCALAR_KERNELS = {"scalar", progressC, lerpC, tweenC};
+
+static Kernels kernels()
+{
+#if defined(KERNEL_X86)
+    if (__builtin_cpu_supports("avx2")) return {"avx2", progressAVX2, lerpAVX2, tweenAVX2};
+    return {"sse2", progressSSE2, lerpSSE2, tweenSSE2};
+#elif defined(KERNEL_NEON)
+    return {"neon", progressNEON, lerpNEON, tweenNEON};
+#else
+    return SCALAR_KERNELS;
+#endif
+}
+
+static const Kernels KERNEL = kernels();
+
 /************************************************************************/
 /* Core Game Logic                                                      */
 /************************************************************************/
@@ -83,16 +303,114 @@ static float SCALE;             //scale factor
 static size_t SWIDTH, SHEIGHT;  //scaled resolution
 static size_t LEVEL = 4;        //game level (0 ~ 9)
 
-struct Tween {
-    uint32_t at;
-    float duration;
-};
-
 struct Color
 {
     uint8_t r, g, b;
 };
 
+//Render a paint once into a new premultiplied ARGB buffer (w x h). The paint is freed with the offscreen canvas.
+static uint32_t* rasterize(Paint* paint, uint32_t w, uint32_t h)
+{
+    auto canvas = SwCanvas::gen();
+    if (!canvas) {
+        paint->ref();
+        paint->unref();
+        return nullptr;
+    }
+
+    auto buffer = (uint32_t*)calloc(w * h, sizeof(uint32_t));
+    canvas->target(buffer, w, w, h, ColorSpace::ARGB8888);
+    canvas->add(paint);
+    canvas->draw();
+    canvas->sync();
+    delete(canvas);
+
+    return buffer;
+}
+
+//Caches the result of a scene with its effects as an image, rendered again only when the content revision changes.
+struct EffectCache
+{
+    static uint32_t hits, misses;
+
+    Scene* slot = nullptr;          //stands in for the source: holds the image, or the source itself without the offscreen
+    Scene* source = nullptr;
+    Picture* picture = nullptr;
+    uint32_t* buffer = nullptr;
+    float margin = 0.0f;            //reach of the effects beyond the content
+    float scale = 1.0f;             //resolution of the image in the source space
+    uint32_t revision = 1;
+    uint32_t cached = 0;
+
+    ~EffectCache()
+    {
+        if (!slot) return;
+        slot->unref();
+        source->unref();
+        picture->unref();
+        free(buffer);
+    }
+
+    Scene* init(Scene* source, float margin, float scale = 1.0f)
+    {
+        this->source = source;
+        this->margin = margin;
+        this->scale = scale;
+        source->ref();
+        picture = Picture::gen();
+        picture->ref();
+        slot = Scene::gen();
+        slot->ref();
+        return slot;
+    }
+
+    void invalidate()
+    {
+        ++revision;
+    }
+
+    void update()
+    {
+        if (cached == revision) {
+            ++hits;
+            return;
+        }
+        ++misses;
+        cached = revision;
+
+        slot->remove();
+
+        float x, y, w, h;
+        source->bounds(&x, &y, &w, &h);
+        x -= margin;
+        y -= margin;
+        auto pw = uint32_t(ceilf((w + margin * 2.0f) * scale));
+        auto ph = uint32_t(ceilf((h + margin * 2.0f) * scale));
+
+        auto wrapper = Scene::gen();
+        wrapper->add(source);
+        wrapper->translate(-x * scale, -y * scale);
+        wrapper->scale(scale);
+
+        auto buffer = rasterize(wrapper, pw, ph);
+        free(this->buffer);
+        this->buffer = buffer;
+
+        if (!buffer) {
+            slot->add(source);
+            return;
+        }
+
+        picture->load(buffer, pw, ph, ColorSpace::ARGB8888, false);
+        picture->translate(x, y);
+        picture->scale(1.0f / scale);
+        slot->add(picture);
+    }
+};
+
+uint32_t EffectCache::hits = 0;
+uint32_t EffectCache::misses = 0;
+
 struct WarZone
 {
     #define GALAXY_LAYER 4
@@ -100,28 +418,110 @@ struct WarZone
 
     Point min = {-2000, -1180}, max = {2000, 1180};
     Point bound = {(WIDTH - max.x) * 0.5f, (HEIGHT - max.y) * 0.5f};
+    //Each star layer is pre-rendered into a wrap-around tile, drawn by 2x2 pictures sharing the tile buffer.
+    //Only the layer scene is translated for the parallax, and the tile is re-rendered on resize.
+    struct Galaxy
+    {
+        Scene* layer;
+        Point stars[STARS_PER_LAYER];   //normalized positions in the tile
+        float size;
+        uint8_t color;
+        uint32_t* buffer = nullptr;
+        uint32_t w = 0, h = 0;          //tile size
+    } galaxy[GALAXY_LAYER];
+
     Scene* model;
-    Shape* galaxy[GALAXY_LAYER];
+    Scene* borders[4];              //blurred ring borders: top, left, right, bottom
+    EffectCache edges[4];           //the borders with their blur as images
+    uint8_t quality = 30;           //blur quality of the borders
+
+    //the static model baked into an image, on demand
+    struct {
+        Picture* picture = nullptr;
+        uint32_t* buffer = nullptr;
+        Point offset;               //top-left of the image in the model parent space
+        float scale = 0.0f;         //scale of the bake
+    } baked;
+
+    Point placed = {FLT_MAX, FLT_MAX};  //translation applied to the zone layer
 
     float w() { return max.x - min.x; }
     float h() { return max.y - min.y; }
 
+    ~WarZone()
+    {
+        for (auto& g : galaxy) free(g.buffer);
+        if (baked.picture) model->unref();
+        free(baked.buffer);
+    }
+
     void star(Canvas* canvas, int i, int ox, int oy, int dx, int dy)
     {
-        galaxy[i] = Shape::gen();
-        auto size = _S(2 * (i+2));
+        auto& g = galaxy[i];
+        g.size = _S(2 * (i+2));
         auto rx = (ox + dx * 2);
         auto ry = (oy + dy * 2);
 
         for (int s = 0; s < STARS_PER_LAYER; ++s) {
-            galaxy[i]->appendRect(_S(rand() % rx - dx), _S(rand() % ry - dy), size, size);
+            auto x = float(rng() % rx);
+            auto y = float(rng() % ry);
+            g.stars[s] = {x / rx, y / ry};
+        }
+        g.color = 200 + rng() % 55;
+        g.layer = Scene::gen();
+        canvas->add(g.layer);
+    }
+
+    //render the layer into a tile of (w x h), the stars on the edges are wrapped to the other side
+    void tile(Galaxy& g, uint32_t w, uint32_t h)
+    {
+        if (g.buffer && g.w == w && g.h == h) return;
+
+        auto shape = Shape::gen();
+        for (auto& s : g.stars) {
+            auto x = s.x * w;
+            auto y = s.y * h;
+            auto wx = x + g.size > w;
+            auto wy = y + g.size > h;
+            shape->appendRect(x, y, g.size, g.size);
+            if (wx) shape->appendRect(x - w, y, g.size, g.size);
+            if (wy) shape->appendRect(x, y - h, g.size, g.size);
+            if (wx && wy) shape->appendRect(x - w, y - h, g.size, g.size);
+        }
+        shape->fill(g.color, g.color, g.color);
+
+        shape->ref();
+        auto buffer = rasterize(shape, w, h);
+
+        g.layer->remove();
+        free(g.buffer);
+        g.buffer = buffer;
+        g.w = w;
+        g.h = h;
+
+        //no software engine for the offscreen, fall back to the vector stars
+        for (int i = 0; i < 4; ++i) {
+            Paint* paint;
+            if (buffer) {
+                auto picture = Picture::gen();
+                picture->load(buffer, w, h, ColorSpace::ARGB8888, false);
+                paint = picture;
+            } else {
+                paint = shape->duplicate();
+            }
+            paint->translate(float(w * (i % 2)), float(h * (i / 2)));
+            g.layer->add(paint);
         }
-        auto c = 200 + rand() % 55;
-        galaxy[i]->fill(c, c, c);
-        canvas->add(galaxy[i]);
+        shape->unref();
     }
 
-    void init(Canvas* canvas)
+    void resize(uint32_t w, uint32_t h)
+    {
+        for (auto& g : galaxy) tile(g, w, h);
+    }
+
+    //the backgrounds go to the canvas, the zone itself to the world
+    void init(Canvas* canvas, Scene* world, uint32_t width, uint32_t height)
     {
         auto halo = Picture::gen();
         halo->load((const char*)HALO_DATA, sizeof(HALO_DATA), "jpg");
@@ -131,6 +531,7 @@ struct WarZone
         for (int i = 0; i < GALAXY_LAYER; ++i) {
             star(canvas, i, WIDTH, HEIGHT, _S(150) * i, _S(150) * i);
         }
+        resize(width, height);
 
         //blue grids
         model = Scene::gen();
@@ -168,42 +569,94 @@ struct WarZone
         Scene* wrapper;
 
         //ring border top
-        wrapper = Scene::gen();
-        wrapper->add(SceneEffect::GaussianBlur, _S(10.0f), 2, 0, 30);
+        wrapper = borders[0] = Scene::gen();
         auto top = Shape::gen();
         top->appendRect(min.x, min.y, w(), 10);
         top->fill(255, 100, 100);
         wrapper->add(top);
-        model->add(wrapper);
+        model->add(edges[0].init(wrapper, 30.0f, SCALE));
 
         //ring border left
-        wrapper = Scene::gen();
-        wrapper->add(SceneEffect::GaussianBlur, _S(10.0f), 1, 0, 30);
+        wrapper = borders[1] = Scene::gen();
         auto left = Shape::gen();
         left->appendRect(min.x, min.y, 10, h());
         left->fill(0, 255, 255);
         wrapper->add(left);
-        model->add(wrapper);
+        model->add(edges[1].init(wrapper, 30.0f, SCALE));
 
         //ring border right
-        wrapper = Scene::gen();
-        wrapper->add(SceneEffect::GaussianBlur, _S(10.0f), 1, 0, 30);
+        wrapper = borders[2] = Scene::gen();
         auto right = Shape::gen();
         right->appendRect(max.x - 5, min.y, 10, h());
         right->fill(170, 255, 170);
         wrapper->add(right);
-        model->add(wrapper);
+        model->add(edges[2].init(wrapper, 30.0f, SCALE));
 
         //ring border bottom
-        wrapper = Scene::gen();
-        wrapper->add(SceneEffect::GaussianBlur, _S(10.0f), 2, 0, 30);
+        wrapper = borders[3] = Scene::gen();
         auto bottom = Shape::gen();
         bottom->appendRect(min.x, max.y, w(), 10);
         bottom->fill(255, 170, 255);
         wrapper->add(bottom);
-        model->add(wrapper);
+        model->add(edges[3].init(wrapper, 30.0f, SCALE));
+
+        blur(quality);
+        for (auto& e : edges) e.update();
+
+        if (tvgdemo::options.bake) {
+            model->ref();
+            bake();
+        }
+        world->add(baked.picture ? (Paint*)baked.picture : model);
+    }
+
+    //render the grids and the blurred borders once, then the image stands in for the model
+    void bake()
+    {
+        #define BAKE_PADDING 40     //room for the border blur
+
+        Point bmin = {min.x - BAKE_PADDING, min.y - BAKE_PADDING};
+        Point bmax = {max.x + 10 + BAKE_PADDING, max.y + 10 + BAKE_PADDING};
+        auto w = uint32_t(ceilf(_S(bmax.x - bmin.x)));
+        auto h = uint32_t(ceilf(_S(bmax.y - bmin.y)));
+
+        auto wrapper = Scene::gen();
+        model->scale(SCALE);
+        model->translate(-_S(bmin.x), -_S(bmin.y));
+        wrapper->add(model);
+
+        auto buffer = rasterize(wrapper, w, h);
+        if (!buffer) {
+            //no software engine for the offscreen, keep drawing the model
+            if (!baked.picture) model->unref(false);
+            return;
+        }
+
+        if (!baked.picture) {
+            baked.picture = Picture::gen();
+        }
+        baked.picture->load(buffer, w, h, ColorSpace::ARGB8888, false);
+        free(baked.buffer);
+        baked.buffer = buffer;
+        baked.offset = {_S(bmin.x), _S(bmin.y)};
+        baked.scale = SCALE;
+        placed = {FLT_MAX, FLT_MAX};
+    }
+
+    void blur(uint8_t quality)
+    {
+        //the baked borders keep their quality
+        if (baked.picture) return;
 
-        canvas->add(model);
+        //blur direction of the borders: horizontal lines vertically, vertical lines horizontally
+        static const int directions[4] = {2, 1, 1, 2};
+
+        this->quality = quality;
+        for (int i = 0; i < 4; ++i) {
+            borders[i]->add(SceneEffect::Clear);
+            borders[i]->add(SceneEffect::GaussianBlur, _S(10.0f), directions[i], 0, int(quality));
+            edges[i].invalidate();
+        }
     }
 
     void shift(const Point& player)
@@ -212,13 +665,112 @@ struct WarZone
         auto y = player.y - SHEIGHT/2;
 
         for (int i = 0; i < GALAXY_LAYER; ++i) {
-            galaxy[i]->translate(-x * _S((i+1) * 0.2), -y * _S((i+1) * 0.2));
+            auto& g = galaxy[i];
+            if (g.w == 0 || g.h == 0) continue;
+            //wrap the parallax offset into (-w, 0], then the 2x2 tiles cover the screen
+            auto ox = fmodf(-x * _S((i+1) * 0.2), float(g.w));
+            auto oy = fmodf(-y * _S((i+1) * 0.2), float(g.h));
+            if (ox > 0.0f) ox -= g.w;
+            if (oy > 0.0f) oy -= g.h;
+            g.layer->translate(ox, oy);
+            PROFILE_TRANSFORMS(1);
+        }
+    }
+
+    //place the zone at pos in the world, the layer is only moved when the position changes
+    void update(const Point& pos)
+    {
+        Paint* layer = model;
+        auto at = pos;
+        if (baked.picture) {
+            if (baked.scale != SCALE) bake();
+            layer = baked.picture;
+            at += baked.offset;
+        } else {
+            for (auto& e : edges) e.update();
         }
+        if (at.x == placed.x && at.y == placed.y) return;
+        layer->translate(at.x, at.y);
+        placed = at;
+        PROFILE_TRANSFORMS(1);
+    }
+};
+
+//Pre-blurred shadows of a silhouette at quantized angles, each rendered on its first use.
+//The shadow is then placed as an image, no gaussian work is left per frame.
+struct ShadowSprites
+{
+    #define SHADOW_ANGLES 128
+
+    Paint* silhouette = nullptr;        //shadow colored source, rotated around its origin
+    Point center;                       //sprite center from the origin, before the rotation
+    float sigma;
+    uint32_t size = 0;
+    uint32_t* sprites[SHADOW_ANGLES] = {};
+
+    ~ShadowSprites()
+    {
+        for (auto s : sprites) free(s);
+        if (silhouette) silhouette->unref();
+    }
+
+    //radius: reach of the silhouette (and the shadow offset) from the center
+    void init(Paint* silhouette, const Point& center, float radius, float sigma)
+    {
+        silhouette->ref();
+        this->silhouette = silhouette;
+        this->center = center;
+        this->sigma = sigma;
+        size = uint32_t(ceilf((radius + sigma * 3.0f) * 2.0f));
+    }
+
+    static int index(float degree)
+    {
+        auto idx = int(lroundf(degree * SHADOW_ANGLES / 360.0f)) % SHADOW_ANGLES;
+        return idx < 0 ? idx + SHADOW_ANGLES : idx;
     }
 
-    void update(const Point& shift)
+    //sprite center from the origin, rotated
+    Point pivot(int idx)
     {
-        model->translate(shift.x, shift.y);
+        Point c = center;
+        rotate(&c, 1, idx * 360.0f / SHADOW_ANGLES);
+        return c;
+    }
+
+    const uint32_t* get(int idx)
+    {
+        if (sprites[idx]) return sprites[idx];
+
+        auto c = pivot(idx);
+        auto rotated = Scene::gen();
+        rotated->add(silhouette->duplicate());
+        rotated->translate(size * 0.5f - c.x, size * 0.5f - c.y);
+        rotated->rotate(idx * 360.0f / SHADOW_ANGLES);
+
+        auto blur = Scene::gen();
+        blur->add(SceneEffect::GaussianBlur, double(sigma), 0, 0, 30);
+        blur->add(rotated);
+
+        sprites[idx] = rasterize(blur, size, size);
+        return sprites[idx];
+    }
+
+    //show the shadow of the silhouette rotated by degree, with the origin at pos. current tracks the loaded sprite.
+    bool place(Picture* picture, int& current, float degree, const Point& pos)
+    {
+        auto idx = index(degree);
+        if (idx != current) {
+            auto sprite = get(idx);
+            if (!sprite) return false;
+            picture->load(sprite, size, size, ColorSpace::ARGB8888, false);
+            current = idx;
+        }
+        auto c = pivot(idx);
+        //whole pixels keep the image on the plain blit path
+        picture->translate(roundf(pos.x + c.x - size * 0.5f), roundf(pos.y + c.y - size * 0.5f));
+        PROFILE_TRANSFORMS(1);
+        return true;
     }
 };
 
@@ -227,107 +779,236 @@ struct Launcher
     #define FIRESPEED 500
     #define MISSLE_MAX 5
     #define FIREDISTANCE _S(2700)
+    #define SPREAD_ANGLE 5.0f
+    #define MISSLE_PTS (ELLIPSE_PTS * 2)
+
+    //projectiles are kept in contiguous arrays, swap-removed when they die.
+    vector<float> x, y;         //current position
+    vector<float> ox, oy;       //fired position
+    vector<float> tx, ty;       //position at the end of the range
+    vector<float> t;            //progress
+    vector<float> cs, sn;       //rotation
+    vector<uint32_t> time;      //fired time
+    vector<uint8_t> alive;      //cleared by kill(), compacted by render()
+    vector<uint8_t> out;        //scratch for the batch bounds check
+
+    //all projectiles are drawn with one path over their shadow sprites
+    vector<PathCommand> cmds;
+    vector<Point> pts;
+    Point outline[MISSLE_PTS];  //missile geometry at the origin
+
+    ShadowSprites sprites;
+    vector<Picture*> shadows;   //shadow slots, one per projectile
+    vector<int> loaded;         //sprite loaded on each slot
+
+    Scene* model;               //screen space, moved against the world by the camera
+    Scene* glows;               //the shadow slots
+    Shape* batch;
+    size_t capacity = MISSLE_MAX;
+    size_t spread = 1;          //projectiles per shot
+    size_t actives = 0;
+    uint32_t lastshot = 0;
+    float fireRate = 150.0f;
 
-    struct Fire
+    size_t size() const { return x.size(); }
+
+    //the projectiles live in the screen space, clipped by the zone in the world
+    void init(Scene* world, float offset, Shape* clipper)
     {
-        Scene* model;
-        Point from, to, cur;
-        float time;
-        bool active;
+        //the dead ones are dropped by render(), until then a full set of new shots can join them
+        auto entries = capacity * 2;
+        x.reserve(entries);
+        y.reserve(entries);
+        ox.reserve(entries);
+        oy.reserve(entries);
+        tx.reserve(entries);
+        ty.reserve(entries);
+        t.reserve(entries);
+        cs.reserve(entries);
+        sn.reserve(entries);
+        time.reserve(entries);
+        alive.reserve(entries);
+        out.reserve(entries);
+        pts.reserve(capacity * MISSLE_PTS);
+
+        static const PathCommand ellipseCmds[] = {
+            PathCommand::MoveTo, PathCommand::CubicTo, PathCommand::CubicTo, PathCommand::CubicTo, PathCommand::CubicTo, PathCommand::Close
+        };
 
-        bool hit(const Point& target, float range)
-        {
-            if (active && intersect(cur, target, range)) {
-                inactivate();
-                return true;
-            }
-            return false;
+        cmds.reserve(capacity * 12);
+        for (size_t i = 0; i < capacity * 2; ++i) {
+            cmds.insert(cmds.end(), ellipseCmds, ellipseCmds + 6);
         }
 
-        void inactivate()
-        {
-            model->opacity(0);
-            active = false;
-        }
-    };
+        ellipse(outline, _S(-20), -offset, _S(10), _S(70));
+        ellipse(outline + MISSLE_PTS / 2, _S(20), -offset, _S(10), _S(70));
 
-    Shape* clipper;
-    vector<Fire> missles;
-    size_t actives = 0;
-    uint32_t lastshot = 0;
-    float fireRate = 150.0f;
+        auto layer = Scene::gen();
+        layer->clip(clipper);
+        world->add(layer);
+
+        //yellow glow around the missile, centered on its pair of ellipses
+        auto silhouette = Shape::gen();
+        silhouette->appendPath(cmds.data(), 12, outline, MISSLE_PTS);
+        silhouette->fill(255, 255, 0);
+        sprites.init(silhouette, {0.0f, -offset}, _S(70), _S(30));
 
-    void init(Canvas* canvas, float offset, Shape* clipper)
+        model = Scene::gen();
+        glows = Scene::gen();
+        model->add(glows);
+        batch = Shape::gen();
+        batch->fill(255, 255, 170);
+        model->add(batch);
+        layer->add(model);
+    }
+
+    void shadow(bool on)
     {
-        missles.reserve(MISSLE_MAX);
+        glows->visible(on);
+    }
 
-        auto model = Scene::gen();
-        model->clip(clipper);
-        canvas->add(model);
-        this->clipper = clipper;
+    void fire(const Point& pos, float dir, uint32_t elapsed)
+    {
+        auto radian = dir / 180.0f * M_PI;
+        x.push_back(pos.x);
+        y.push_back(pos.y);
+        ox.push_back(pos.x);
+        oy.push_back(pos.y);
+        tx.push_back(pos.x + sinf(radian) * FIREDISTANCE);
+        ty.push_back(pos.y - cosf(radian) * FIREDISTANCE);
+        t.push_back(0.0f);
+        cs.push_back(cosf(radian));
+        sn.push_back(sinf(radian));
+        time.push_back(elapsed);
+        alive.push_back(1);
+        ++actives;
+    }
+
+    void kill(size_t i)
+    {
+        if (!alive[i]) return;
+        alive[i] = 0;
+        --actives;
+    }
+
+    void clear()
+    {
+        for (size_t i = 0; i < size(); ++i) alive[i] = 0;
+        actives = 0;
+    }
 
-        for (int i = 0; i < MISSLE_MAX; ++i) {
-            auto wrapper = Scene::gen();
-            wrapper->add(SceneEffect::DropShadow, 255, 255, 0, 255, 0.0f, 0.0f, _S(30), 30);
-            auto shape = Shape::gen();
-            shape->appendCircle(_S(-20), -offset, _S(10), _S(70));
-            shape->appendCircle(_S(20), -offset, _S(10), _S(70));
-            shape->fill(255, 255, 170);
-            wrapper->add(shape);
-            missles.push_back({wrapper, });
-            model->add(wrapper);
+    void remove(size_t i)
+    {
+        auto last = size() - 1;
+        x[i] = x[last]; y[i] = y[last];
+        ox[i] = ox[last]; oy[i] = oy[last];
+        tx[i] = tx[last]; ty[i] = ty[last];
+        t[i] = t[last];
+        cs[i] = cs[last]; sn[i] = sn[last];
+        time[i] = time[last];
+        alive[i] = alive[last];
+        x.pop_back(); y.pop_back();
+        ox.pop_back(); oy.pop_back();
+        tx.pop_back(); ty.pop_back();
+        t.pop_back();
+        cs.pop_back(); sn.pop_back();
+        time.pop_back();
+        alive.pop_back();
+    }
+
+    //flag the projectiles out of the given rect, branchless so that it's vectorized.
+    const uint8_t* outside(float minx, float miny, float maxx, float maxy)
+    {
+        auto cnt = size();
+        out.resize(cnt);
+        auto px = x.data();
+        auto py = y.data();
+        auto po = out.data();
+        for (size_t i = 0; i < cnt; ++i) {
+            po[i] = (px[i] < minx) | (px[i] > maxx) | (py[i] < miny) | (py[i] > maxy);
         }
+        return po;
     }
 
-    void update(const Point& pos, const Point& direction, float dir, uint32_t elapsed, const Point& shift, bool shoot)
+    void update(const Point& pos, float dir, uint32_t elapsed, const Point& camera, bool shoot)
     {
-        clipper->translate(shift.x, shift.y);
+        model->translate(-camera.x, -camera.y);
 
         if (shoot && elapsed - lastshot > fireRate) lastshot = elapsed;
         else shoot = false;
 
-        for (auto& fire : missles) {
-            if (shoot && !fire.active) {
-                fire.to = direction;
-                extend(fire.to, FIREDISTANCE);
-                fire.to += pos;
-                fire.from = pos;
-                fire.time = elapsed;
-                fire.active = true;
-                fire.model->opacity(255);
-                fire.model->rotate(dir);
-                shoot = false;
-                ++actives;
+        //retire and move
+        auto cnt = size();
+        for (size_t i = 0; i < cnt; ++i) {
+            if (elapsed - time[i] > FIRESPEED) kill(i);
+            t[i] = float(elapsed - time[i]) / FIRESPEED;
+        }
+        KERNEL.lerp(ox.data(), tx.data(), t.data(), x.data(), cnt);
+        KERNEL.lerp(oy.data(), ty.data(), t.data(), y.data(), cnt);
+
+        if (shoot) {
+            for (size_t i = 0; i < spread && actives < capacity; ++i) {
+                fire(pos, dir + (float(i) - float(spread - 1) * 0.5f) * SPREAD_ANGLE, elapsed);
             }
-            if (fire.active) {
-                auto progress = float(elapsed - fire.time) / FIRESPEED;
-                if (progress <= 1.0f) {
-                    fire.cur = {lerp(fire.from.x, fire.to.x, progress), lerp(fire.from.y, fire.to.y, progress)};
-                    fire.model->translate(fire.cur.x, fire.cur.y);
-                } else {
-                    fire.inactivate();
-                    --actives;
-                }
+        }
+    }
+
+    //drop the dead projectiles and rebuild the batch path
+    void render()
+    {
+        for (size_t i = 0; i < size(); ) {
+            if (alive[i]) ++i;
+            else remove(i);
+        }
+
+        pts.resize(size() * MISSLE_PTS);
+        auto dst = pts.data();
+        for (size_t i = 0; i < size(); ++i) {
+            for (int p = 0; p < MISSLE_PTS; ++p, ++dst) {
+                dst->x = x[i] + outline[p].x * cs[i] - outline[p].y * sn[i];
+                dst->y = y[i] + outline[p].x * sn[i] + outline[p].y * cs[i];
             }
         }
+
+        batch->reset();
+        if (size() > 0) batch->appendPath(cmds.data(), size() * 12, pts.data(), pts.size());
+
+        //shadow slots, grown on demand and hidden when unused
+        while (shadows.size() < size()) {
+            auto picture = Picture::gen();
+            glows->add(picture);
+            shadows.push_back(picture);
+            loaded.push_back(-1);
+        }
+        for (size_t i = 0; i < shadows.size(); ++i) {
+            auto show = i < size() && sprites.place(shadows[i], loaded[i], atan2f(sn[i], cs[i]) * 180.0f / M_PI, {x[i], y[i]});
+            shadows[i]->visible(show);
+        }
     }
 };
 
 struct Player
 {
     Launcher launcher;
+    ShadowSprites sprites;
     Scene* model;
+    Scene* ship;
+    Picture* shade;
+    int loaded = -1;            //sprite loaded on the shade
     Point pos, ray, direction;
     float dir = 0.0f;
     float speed = 0.7f;
     float bound;
     bool shoot = false;
+    bool shadow = true;
 
-    void init(Canvas* canvas, const Point& pos, Shape* clipper)
+    void init(Scene* world, const Point& pos, Shape* clipper)
     {
         bound = _S(40.0f);
 
-        launcher.init(canvas, bound * 3, clipper);
+        if (tvgdemo::options.missiles > 0) launcher.capacity = tvgdemo::options.missiles;
+        launcher.spread = tvgdemo::options.spread;
+        launcher.init(world, bound * 3, clipper);
 
         static const PathCommand cmds[] = {
             PathCommand::MoveTo,PathCommand::LineTo, PathCommand::LineTo, PathCommand::LineTo, PathCommand::LineTo,
@@ -349,13 +1030,30 @@ struct Player
         shape->strokeWidth(8.0f);
         shape->strokeFill(200, 200, 255);
 
-        model = Scene::gen();
-        model->add(light);
-        model->add(shape);
+        //shadow source, the ship in the shadow color behind the ship
+        auto silhouette = Scene::gen();
+        auto sl = static_cast<Shape*>(light->duplicate());
+        sl->fill(200, 200, 255, 17);
+        auto ss = static_cast<Shape*>(shape->duplicate());
+        ss->fill(200, 200, 255, 127);
+        silhouette->add(sl);
+        silhouette->add(ss);
+        silhouette->translate(0.0f, _S(20.0f));
+        silhouette->scale(SCALE);
+        sprites.init(silhouette, {0.0f, _S(20.0f)}, _S(95.0f + 4.0f), _S(30.0f));
+
+        shade = Picture::gen();
+
+        ship = Scene::gen();
+        ship->add(light);
+        ship->add(shape);
+        ship->scale(SCALE);
 
+        model = Scene::gen();
+        model->add(shade);
+        model->add(ship);
         model->translate(pos.x, pos.y);
-        model->scale(SCALE);
-        canvas->add(model);
+        world->add(model);
 
         this->pos = pos;
     }
@@ -395,17 +1093,20 @@ struct Player
         dir += _S(speed) * multiplier;
     }
 
-    void update(uint32_t elapsed, const Point& shift)
+    //pos is on the screen, the ship is placed in the world seen by the camera. the projectiles stay on the screen.
+    void update(uint32_t elapsed, const Point& camera)
     {
+        PROFILE_SCOPE("player");
+
         auto radian = dir / 180.0f * M_PI;
         direction = {_S(sinf(radian)), -_S(cosf(radian))};
         normalize(direction);
 
-        launcher.update(pos, direction, dir, elapsed, shift, shoot);
-        model->add(SceneEffect::Clear);
-        model->add(SceneEffect::DropShadow, 200, 200, 255, 255, dir + 180.0f, _S(20.0f), _S(30), 30);
-        model->rotate(dir);
-        model->translate(pos.x, pos.y);
+        launcher.update(pos, dir, elapsed, camera, shoot);
+        shade->visible(shadow && sprites.place(shade, loaded, dir, {0.0f, 0.0f}));
+        ship->rotate(dir);
+        model->translate(pos.x - camera.x, pos.y - camera.y);
+        PROFILE_TRANSFORMS(3);
     }
 };
 
@@ -413,185 +1114,390 @@ struct Enemy
 {
     #define ENEMY_DURATION_LEVEL 1000
 
+    enum Type : uint8_t {BOXER = 0, TRIPOD, SANDER, HEXEN};
+
     static constexpr const size_t MAX_ROTATION = 20;
     static constexpr const size_t NUM_ENEMY_TYPE = 4;
     static constexpr const uint32_t BASETIME = 9200;
     static uint32_t DURATION;
     static float BOUND;
+    static BlendMethod BLEND;
 
-    Shape* model;
-    float scale = 1.0f;
-    int type;
-
-    struct {
-        Point from, to, cur;
-    } pos;
-
-    struct {
-        float from, to;
-    } dir;
+    static constexpr const float STROKE = 8.0f;
 
-    Tween time;
+    static Paint* gen(int type);
 
-    Enemy(int type) : model(Shape::gen()), type(type)
+    //closed polygon of the type
+    static size_t polygon(int type, const Point** pts)
     {
-        model->ref();
-        model->strokeWidth(8.0f);
-        model->scale(SCALE);
-        model->blend(BlendMethod::Add);
+        static const Point boxer[] = {{-40, -40}, {40, -40}, {40, 40}, {-40, 40}};
+        static const Point tripod[] = {{0, -40}, {40, 40}, {-40, 40}};
+        static const Point sander[] = {{0, -8}, {40, -40}, {40, 40}, {0, 8}, {-40, 40}, {-40, -40}};
+        static const Point hexen[] = {{0, -40}, {40, -20}, {40, 20}, {0, 40}, {-40, 20}, {-40, -20}};
+
+        switch (type) {
+            case BOXER: *pts = boxer; return 4;
+            case TRIPOD: *pts = tripod; return 3;
+            case SANDER: *pts = sander; return 6;
+            default: *pts = hexen; return 6;
+        }
     }
 
-    virtual ~Enemy()
+    static Shape* body(int type)
     {
-        model->unref();
-    }
+        static const Color fills[NUM_ENEMY_TYPE] = {{50, 0, 0}, {0, 50, 0}, {50, 35, 50}, {0, 50, 50}};
 
-    void init(Scene* elayer, const Point shift, uint32_t elapsed)
-    {
-        if (type == 0 || type == 4) {         //top -> bottom
-            pos = {{float(rand() % SWIDTH), -BOUND * 2}, {float(rand() % SWIDTH), SHEIGHT + BOUND * 2}};
-        } else if (type == 1) {               //right -> left
-            pos = {{float(SWIDTH + BOUND), float(rand() % SHEIGHT)}, {-BOUND, float(rand() % SHEIGHT)}};
-        } else if (type == 2) {               //bottom -> top
-            pos = {{float(rand() % SWIDTH), SHEIGHT + BOUND * 2}, {float(rand() % SWIDTH), -BOUND * 2}};
-        } else if (type == 3) {               //left -> right
-            pos = {{-BOUND, float(rand() % SHEIGHT)}, {float(SWIDTH + BOUND), float(rand() % SHEIGHT)}};
-        }
+        const Point* pts;
+        auto cnt = polygon(type, &pts);
 
-        time = {elapsed, float(BASETIME + (rand() % DURATION))};
-        dir = {float(rand() % 360), float(rand() % (360 * MAX_ROTATION))};
-        model->rotate(dir.from);
-        model->translate(pos.from.x, pos.from.y);
-        elayer->add(model);
+        auto model = Shape::gen();
+        model->moveTo(pts[0].x, pts[0].y);
+        for (size_t i = 1; i < cnt; ++i) model->lineTo(pts[i].x, pts[i].y);
+        model->close();
+        model->fill(fills[type].r, fills[type].g, fills[type].b);
+        return model;
     }
 
-    virtual int update(uint32_t elapsed, Launcher& launcher, const Point& p2o, Point& target)
+    //vector model of the type, stroked by the engine
+    static Shape* shape(int type)
     {
-        auto progress = float(elapsed - time.at) / time.duration;
-        if (progress > 1.0f) return 1;
-
-        pos.cur = {lerp(pos.from.x, pos.to.x, progress), lerp(pos.from.y, pos.to.y, progress)};
-        target = pos.cur + p2o;
+        auto model = body(type);
+        auto c = color(type);
+        model->strokeFill(c.r, c.g, c.b);
+        model->strokeWidth(STROKE);
+        return model;
+    }
 
-        auto range = pow(BOUND + BOUND, 2);
+    //The stroke of the type converted into a filled path once: a quad per edge and the bevel join triangles per corner,
+    //all wound the same way for the nonzero fill. The path is in the model space, the instance transform scales it with SCALE,
+    //so it's never converted again. The instances only copy it, no stroke is generated when they move.
+    static void outline(int type, Shape* shape)
+    {
+        static struct {
+            vector<PathCommand> cmds;
+            vector<Point> pts;
+        } cache[NUM_ENEMY_TYPE];
+
+        auto& c = cache[type];
+
+        if (c.pts.empty()) {
+            const Point* pts;
+            auto cnt = polygon(type, &pts);
+            auto hw = STROKE * 0.5f;
+
+            //edge normals
+            Point normals[6];
+            for (size_t i = 0; i < cnt; ++i) {
+                auto d = pts[(i + 1) % cnt] - pts[i];
+                normalize(d);
+                normals[i] = {-d.y * hw, d.x * hw};
+            }
 
-        if (launcher.actives > 0) {
-            for (auto& fire : launcher.missles) {
-                if (fire.hit(target, range)) {
-                    --launcher.actives;
-                    return 2;
+            //every piece is wound as the edge quads, negative in the y-down space
+            auto append = [&](const Point* p, int n) {
+                auto area = 0.0f;
+                for (int k = 0; k < n; ++k) {
+                    auto& a = p[k];
+                    auto& b = p[(k + 1) % n];
+                    area += a.x * b.y - b.x * a.y;
                 }
+                c.cmds.push_back(PathCommand::MoveTo);
+                for (int k = 1; k < n; ++k) c.cmds.push_back(PathCommand::LineTo);
+                c.cmds.push_back(PathCommand::Close);
+                if (area > 0.0f) for (int k = n; k-- > 0; ) c.pts.push_back(p[k]);
+                else c.pts.insert(c.pts.end(), p, p + n);
+            };
+
+            for (size_t i = 0; i < cnt; ++i) {
+                auto& p0 = pts[i];
+                auto& p1 = pts[(i + 1) % cnt];
+                auto& n = normals[i];
+                Point quad[] = {p0 + n, p1 + n, p1 - n, p0 - n};
+                append(quad, 4);
+
+                //bevel of the corner at p1. the polygons are clockwise, so the normals point inward and the bevel
+                //of a convex corner is the outer triangle, the inner one is hidden in the quads. both are kept since
+                //the concave corners of the sander turn the other way.
+                auto& m = normals[(i + 1) % cnt];
+                Point inner[] = {p1, p1 + n, p1 + m};
+                Point outer[] = {p1, p1 - n, p1 - m};
+                append(inner, 3);
+                append(outer, 3);
             }
         }
 
-        model->translate(pos.cur.x, pos.cur.y);
-        model->rotate(lerp(dir.from, dir.to, progress));
+        shape->appendPath(c.cmds.data(), c.cmds.size(), c.pts.data(), c.pts.size());
+    }
 
-        return 0;
+    //vector model of the type with the pre-outlined stroke
+    static Scene* outlined(int type)
+    {
+        auto stroke = Shape::gen();
+        outline(type, stroke);
+        auto c = color(type);
+        stroke->fill(c.r, c.g, c.b);
+
+        auto model = Scene::gen();
+        model->add(body(type));
+        model->add(stroke);
+        return model;
     }
 
-    virtual Color color() = 0;
+    //the parts of a scene model are blended, a blended scene would be composed offscreen
+    static void blend(Paint* model, BlendMethod method)
+    {
+        if (model->type() != tvg::Type::Scene) {
+            model->blend(method);
+            return;
+        }
+        for (auto p : static_cast<Scene*>(model)->paints()) p->blend(method);
+    }
+
+    static Color color(int type)
+    {
+        static const Color colors[NUM_ENEMY_TYPE] = {{255, 50, 50}, {170, 255, 170}, {255, 120, 255}, {0, 255, 255}};
+        return colors[type];
+    }
 };
 
 uint32_t Enemy::DURATION = 9500 - (LEVEL * ENEMY_DURATION_LEVEL);
 float Enemy::BOUND;
+BlendMethod Enemy::BLEND = BlendMethod::Add;
 
-struct Boxer : Enemy
+//Every enemy type pre-rendered at ATLAS_STEPS rotations. The frames are stacked vertically in one strip per type,
+//so each frame is a contiguous image to load. It's valid only at the scale it was built with.
+static struct EnemyAtlas
 {
-    static int type;
+    #define ATLAS_STEPS 128
 
-    Boxer(Scene* elayer, const Point& bound, uint32_t elapsed) : Enemy(Boxer::type)
-    {
-        model->appendRect(-40, -40, 80, 80);
-        model->fill(50, 0, 0);
-        model->strokeFill(255, 50, 50);
+    uint32_t* strips[Enemy::NUM_ENEMY_TYPE] = {};
+    uint32_t size = 0;          //frame width and height
+    float scale = 0.0f;         //scale of the build
 
-        init(elayer, bound, elapsed);
+    ~EnemyAtlas()
+    {
+        for (auto s : strips) free(s);
     }
 
-    Color color() override { return {255, 50, 50}; }
-};
-
-struct Tripod : Enemy
-{
-    static int type;
+    bool valid()
+    {
+        return size > 0 && scale == SCALE;
+    }
 
-    Tripod(Scene* elayer, const Point& bound, uint32_t elapsed) : Enemy(Tripod::type)
+    bool build()
     {
-        model->moveTo(0, -40);
-        model->lineTo(40, 40);
-        model->lineTo(-40, 40);
-        model->close();
-        model->strokeFill(170, 255, 170);
-        model->fill(0, 50, 0);
+        //the rotated outline with the stroke fits in the frame
+        size = uint32_t(ceilf(_S((40.0f + 4.0f) * 1.4143f) * 2.0f)) + 2;
+
+        for (size_t type = 0; type < Enemy::NUM_ENEMY_TYPE; ++type) {
+            auto strip = Scene::gen();
+            for (int i = 0; i < ATLAS_STEPS; ++i) {
+                auto shape = Enemy::shape(type);
+                shape->translate(size * 0.5f, size * (i + 0.5f));
+                shape->rotate(i * 360.0f / ATLAS_STEPS);
+                shape->scale(SCALE);
+                strip->add(shape);
+            }
+            free(strips[type]);
+            strips[type] = rasterize(strip, size, size * ATLAS_STEPS);
+            if (!strips[type]) {
+                size = 0;
+                return false;
+            }
+        }
+        scale = SCALE;
+        return true;
+    }
 
-        init(elayer, bound, elapsed);
+    static int frame(float degree)
+    {
+        auto idx = int(lroundf(degree * ATLAS_STEPS / 360.0f)) % ATLAS_STEPS;
+        return idx < 0 ? idx + ATLAS_STEPS : idx;
     }
 
-    Color color() override { return {170, 255, 170}; }
-};
+    //show the frame of the rotation centered at (x, y). loaded tracks the frame on the picture.
+    void place(Picture* picture, int type, int16_t& loaded, float degree, float x, float y)
+    {
+        auto idx = frame(degree);
+        if (idx != loaded) {
+            picture->load(strips[type] + size * size * idx, size, size, ColorSpace::ARGB8888, false);
+            loaded = idx;
+        }
+        picture->translate(roundf(x - size * 0.5f), roundf(y - size * 0.5f));
+    }
+} ATLAS;
 
-struct Sander : Enemy
+//atlas image when the atlas is available, the outlined vector shape otherwise
+Paint* Enemy::gen(int type)
 {
-    static int type;
+    Paint* model;
+    if (ATLAS.valid()) model = Picture::gen();
+    else model = outlined(type);
+    blend(model, BLEND);
+    model->ref();
+    return model;
+}
 
-    Sander(Scene* elayer, const Point& bound, uint32_t elapsed) : Enemy(Sander::type)
+//Live enemies in parallel arrays, swap-removed. Only the final transforms are pushed to the models.
+struct Enemies
+{
+    vector<float> fx, fy;       //from
+    vector<float> tx, ty;       //to
+    vector<float> cx, cy;       //current
+    vector<float> rfrom, rto;   //rotation (degree)
+    vector<float> rot;          //current rotation
+    vector<uint32_t> at;        //tween start
+    vector<float> duration;     //tween duration
+    vector<float> progress;
+    vector<uint8_t> type;
+    vector<uint8_t> done;       //passed through the zone
+    vector<uint8_t> shown;      //inside of the view
+    vector<int16_t> frame;      //atlas frame loaded on the model, -1: none
+    vector<Paint*> model;
+
+    size_t size() const { return type.size(); }
+    Point cur(size_t i) const { return {cx[i], cy[i]}; }
+
+    void reserve(size_t n)
     {
-        static const PathCommand cmds[] = {
-            PathCommand::MoveTo,
-            PathCommand::LineTo,
-            PathCommand::LineTo,
-            PathCommand::LineTo,
-            PathCommand::LineTo,
-            PathCommand::LineTo,
-            PathCommand::Close
-        };
-
-        static const Point pts[] = {{0, -8}, {40, -40}, {40, 40}, {0, 8}, {-40, 40}, {-40, -40}};
+        fx.reserve(n); fy.reserve(n);
+        tx.reserve(n); ty.reserve(n);
+        cx.reserve(n); cy.reserve(n);
+        rfrom.reserve(n); rto.reserve(n); rot.reserve(n);
+        at.reserve(n);
+        duration.reserve(n);
+        progress.reserve(n);
+        type.reserve(n);
+        done.reserve(n);
+        shown.reserve(n);
+        frame.reserve(n);
+        model.reserve(n);
+    }
 
-        model->appendPath(cmds, 7, pts, 6);
-        model->strokeFill(255, 120, 255);
-        model->fill(50, 35, 50);
+    void spawn(int type, Paint* model, uint32_t elapsed)
+    {
+        auto BOUND = Enemy::BOUND;
+        Point from, to;
+
+        if (type == Enemy::BOXER) {              //top -> bottom
+            from = {float(rng() % SWIDTH), -BOUND * 2};
+            to = {float(rng() % SWIDTH), SHEIGHT + BOUND * 2};
+        } else if (type == Enemy::TRIPOD) {      //right -> left
+            from = {float(SWIDTH + BOUND), float(rng() % SHEIGHT)};
+            to = {-BOUND, float(rng() % SHEIGHT)};
+        } else if (type == Enemy::SANDER) {      //bottom -> top
+            from = {float(rng() % SWIDTH), SHEIGHT + BOUND * 2};
+            to = {float(rng() % SWIDTH), -BOUND * 2};
+        } else {                                 //left -> right
+            from = {-BOUND, float(rng() % SHEIGHT)};
+            to = {float(SWIDTH + BOUND), float(rng() % SHEIGHT)};
+        }
 
-        init(elayer, bound, elapsed);
+        fx.push_back(from.x); fy.push_back(from.y);
+        tx.push_back(to.x); ty.push_back(to.y);
+        cx.push_back(from.x); cy.push_back(from.y);
+        at.push_back(elapsed);
+        duration.push_back(float(Enemy::BASETIME + (rng() % Enemy::DURATION)));
+        progress.push_back(0.0f);
+        rfrom.push_back(float(rng() % 360));
+        rto.push_back(float(rng() % (360 * Enemy::MAX_ROTATION)));
+        rot.push_back(rfrom.back());
+        this->type.push_back(type);
+        done.push_back(0);
+        shown.push_back(1);
+        frame.push_back(-1);
+        this->model.push_back(model);
+
+        model->visible(true);
+        transform(size() - 1);
     }
 
-    Color color() override { return {255, 120, 255}; }
-};
-
-struct Hexen : Enemy
-{
-    static int type;
+    //swap-remove, the order of the rest is deterministic.
+    void remove(size_t i)
+    {
+        auto last = size() - 1;
+        fx[i] = fx[last]; fy[i] = fy[last];
+        tx[i] = tx[last]; ty[i] = ty[last];
+        cx[i] = cx[last]; cy[i] = cy[last];
+        rfrom[i] = rfrom[last]; rto[i] = rto[last]; rot[i] = rot[last];
+        at[i] = at[last];
+        duration[i] = duration[last];
+        progress[i] = progress[last];
+        type[i] = type[last];
+        done[i] = done[last];
+        shown[i] = shown[last];
+        frame[i] = frame[last];
+        model[i] = model[last];
+
+        fx.pop_back(); fy.pop_back();
+        tx.pop_back(); ty.pop_back();
+        cx.pop_back(); cy.pop_back();
+        rfrom.pop_back(); rto.pop_back(); rot.pop_back();
+        at.pop_back();
+        duration.pop_back();
+        progress.pop_back();
+        type.pop_back();
+        done.pop_back();
+        shown.pop_back();
+        frame.pop_back();
+        model.pop_back();
+    }
 
-    Hexen(Scene* elayer, const Point& bound, uint32_t elapsed) : Enemy(Hexen::type)
-    {        
-        static const PathCommand cmds[] = {
-            PathCommand::MoveTo,
-            PathCommand::LineTo,
-            PathCommand::LineTo,
-            PathCommand::LineTo,
-            PathCommand::LineTo,
-            PathCommand::LineTo,
-            PathCommand::Close
-        };
+    void clear()
+    {
+        while (size() > 0) remove(size() - 1);
+    }
 
-        static const Point pts[] = {{0, -40}, {40, -20}, {40, 20}, {0, 40}, {-40, 20}, {-40, -20}};
+    //tween all, flag the ones passed through the zone
+    void update(uint32_t elapsed)
+    {
+        auto cnt = size();
+        auto t = progress.data();
+        KERNEL.progress(at.data(), duration.data(), elapsed, t, cnt);
+        KERNEL.lerp(fx.data(), tx.data(), t, cx.data(), cnt);
+        KERNEL.lerp(fy.data(), ty.data(), t, cy.data(), cnt);
+        KERNEL.lerp(rfrom.data(), rto.data(), t, rot.data(), cnt);
+        for (size_t i = 0; i < cnt; ++i) {
+            done[i] = t[i] > 1.0f;
+        }
+    }
 
-        model->appendPath(cmds, 7, pts, 6);
-        model->strokeFill(0, 255, 255);
-        model->fill(0, 50, 50);
+    //translate * rotate * scale in one matrix, or the atlas frame of the rotation
+    void transform(size_t i)
+    {
+        PROFILE_TRANSFORMS(1);
+        if (model[i]->type() == tvg::Type::Picture) {
+            ATLAS.place(static_cast<Picture*>(model[i]), type[i], frame[i], rot[i], cx[i], cy[i]);
+            return;
+        }
+        auto radian = rot[i] / 180.0f * M_PI;
+        auto c = cosf(radian) * SCALE;
+        auto s = sinf(radian) * SCALE;
+        model[i]->transform({c, -s, cx[i], s, c, cy[i], 0.0f, 0.0f, 1.0f});
+    }
 
-        init(elayer, bound, elapsed);
+    //hide the enemies outside of the view (min, max), their positions are still tweened for the collision.
+    void cull(const Point& min, const Point& max)
+    {
+        auto BOUND = Enemy::BOUND;
+        for (size_t i = 0; i < size(); ++i) {
+            uint8_t in = (cx[i] > min.x - BOUND) & (cx[i] < max.x + BOUND) & (cy[i] > min.y - BOUND) & (cy[i] < max.y + BOUND);
+            if (in == shown[i]) continue;
+            model[i]->visible(in);
+            shown[i] = in;
+        }
     }
 
-    Color color() override { return {0, 255, 255}; }
+    void transform()
+    {
+        for (size_t i = 0; i < size(); ++i) {
+            if (shown[i]) transform(i);
+        }
+    }
 };
 
-int Boxer::type = 0;
-int Tripod::type = 1;
-int Sander::type = 2;
-int Hexen::type = 3;
-
+//The particles and the flashes are transformed on the CPU and merged into a few paths,
+//so an explosion costs 6 paints instead of 86.
 struct Explosion
 {
     #define PARTICLE_TIME 1000
@@ -599,24 +1505,36 @@ struct Explosion
     #define MAX_ROTATION 10
     #define PARTICLE_DIST 250
     #define PARTICLE_EXTRA 80
+    #define PARTICLE_TOTAL (PARTICLE_NUM + PARTICLE_EXTRA)
+    #define FLASH_BUCKETS 4     //random colored flashes are grouped into these many colors
+    #define FLASH_GLOWS (PARTICLE_EXTRA / 2)
+    #define FLASH_SPARKS (PARTICLE_EXTRA - FLASH_GLOWS)
 
     Scene* model;
     uint32_t begin;   //begin tick
     Point pos;
     bool destroy = false;
+    bool shown = true;          //inside of the view
 
-    struct {
-        Shape* shape;
-        Point to;
-        struct {
-            float from, to;
-        } dir;
-    } particle[PARTICLE_NUM];
+    //level of detail
+    int particleCnt = PARTICLE_NUM;
+    int glowCnt = FLASH_GLOWS;
+    int sparkCnt = FLASH_SPARKS;
+
+    Shape* particles;                   //all destroy particles
+    Shape* glows[FLASH_BUCKETS];        //elliptic flashes, per color bucket
+    Shape* sparks;                      //thin flashes
+
+    //destinations of the particles followed by the flashes, tweened in one batch
+    float tx[PARTICLE_TOTAL], ty[PARTICLE_TOTAL];
 
     struct {
-        Shape* shape;
-        Point to;
-    } flashes[PARTICLE_EXTRA];
+        float from, to;
+    } dir[PARTICLE_NUM];
+
+    //flash outlines, rotated at the origin
+    Point glowPts[FLASH_GLOWS * ELLIPSE_PTS];
+    Point sparkPts[FLASH_SPARKS * 4];
 
     ~Explosion()
     {
@@ -627,105 +1545,170 @@ struct Explosion
     {
         model->ref();
 
-        //destroy particle
-        for (int i = 0; i < PARTICLE_NUM; ++i) {
-            particle[i].shape = Shape::gen();
-            particle[i].shape->appendRect(0, 0, _S(8.0f), _S(60.0f));
-            model->add(particle[i].shape);
-        }
+        particles = Shape::gen();
+        model->add(particles);
 
-        //flash particle
-        for (int i = 0; i < PARTICLE_EXTRA; ++i) {
-            flashes[i].shape = Shape::gen();
-            flashes[i].shape->blend(BlendMethod::Add);
-            model->add(flashes[i].shape);
+        for (int i = 0; i < FLASH_BUCKETS; ++i) {
+            glows[i] = Shape::gen();
+            glows[i]->blend(BlendMethod::Add);
+            model->add(glows[i]);
         }
+
+        sparks = Shape::gen();
+        sparks->blend(BlendMethod::Add);
+        model->add(sparks);
+    }
+
+    //particle counts for the given share of the particle budget
+    void lod(size_t share)
+    {
+        auto extra = std::clamp<size_t>(share * PARTICLE_EXTRA / PARTICLE_TOTAL, FLASH_BUCKETS * 2, PARTICLE_EXTRA);
+        glowCnt = std::max<size_t>(extra / 2 / FLASH_BUCKETS, 1) * FLASH_BUCKETS;
+        sparkCnt = std::min<size_t>(extra - glowCnt, FLASH_SPARKS);
+        particleCnt = std::clamp<size_t>(share * PARTICLE_NUM / PARTICLE_TOTAL, 2, PARTICLE_NUM);
     }
 
     void init(const Point& pos, uint32_t elapsed)
     {
+        auto tx = this->tx + PARTICLE_NUM;
+        auto ty = this->ty + PARTICLE_NUM;
+
         auto w1 = _S(14.0f);
-        for (int i = 0; i < PARTICLE_EXTRA / 2; ++i) {
-            auto length = _S(rand() % 40 + 40);
-            flashes[i].shape->reset();
-            flashes[i].shape->appendRect(-w1, -length, w1 * 2.0f, length * 2, w1, length);
-            auto dir = rand() % 360;
-            flashes[i].shape->rotate(dir);
+        //the whole geometry is generated, lod() only picks how much of it is drawn
+        for (int i = 0; i < FLASH_GLOWS; ++i) {
+            auto length = _S(rng() % 40 + 40);
+            auto pts = glowPts + i * ELLIPSE_PTS;
+            ellipse(pts, 0.0f, 0.0f, w1, length);
+            auto dir = rng() % 360;
+            rotate(pts, ELLIPSE_PTS, dir);
             auto to = length * 25.0f;
             auto rad = dir / 180.0f * M_PI;
-            flashes[i].to.x = -to * sin(rad) + pos.x;
-            flashes[i].to.y = +to * cos(rad) + pos.y;
+            tx[i] = -to * sin(rad) + pos.x;
+            ty[i] = +to * cos(rad) + pos.y;
         }
 
         auto w2 = _S(1.5f);
-        for (int i = PARTICLE_EXTRA / 2; i < PARTICLE_EXTRA; ++i) {
-            auto length = _S(rand() % 40 + 40);
-            flashes[i].shape->reset();
-            flashes[i].shape->appendRect(-w2, -length, w2 * 2.0f, length * 2);
-            auto dir = rand() % 360;
-            flashes[i].shape->rotate(dir);
+        for (int i = 0; i < FLASH_SPARKS; ++i) {
+            auto length = _S(rng() % 40 + 40);
+            auto pts = sparkPts + i * 4;
+            pts[0] = {-w2, -length};
+            pts[1] = {w2, -length};
+            pts[2] = {w2, length};
+            pts[3] = {-w2, length};
+            auto dir = rng() % 360;
+            rotate(pts, 4, dir);
             auto to = length * 30.0f;
             auto rad = dir / 180.0f * M_PI;
-            flashes[i].to.x = -to * sin(rad) + pos.x;
-            flashes[i].to.y = +to * cos(rad) + pos.y;
+            tx[FLASH_GLOWS + i] = -to * sin(rad) + pos.x;
+            ty[FLASH_GLOWS + i] = +to * cos(rad) + pos.y;
         }
 
         this->destroy = false;
         this->pos = pos;
         this->begin = elapsed;
+        this->shown = true;
+        model->visible(true);
     }
 
     void init(const Point& pos, Point dir, const Color& color, uint32_t elapsed)
     {
         extend(dir, _S(PARTICLE_DIST));
 
+        particles->fill(color.r, color.g, color.b);
+
         for (int i = 0; i < PARTICLE_NUM; ++i) {
-            particle[i].shape->fill(color.r, color.g, color.b);
-            particle[i].to.x = _S(rand() % 1000) - _S(500) + pos.x + dir.x;
-            particle[i].to.y = _S(rand() % 1000) - _S(500) + pos.y + dir.y;
-            particle[i].dir.from = rand() % 360;
-            particle[i].dir.to = rand() % MAX_ROTATION;
+            tx[i] = _S(rng() % 1000) - _S(500) + pos.x + dir.x;
+            ty[i] = _S(rng() % 1000) - _S(500) + pos.y + dir.y;
+            this->dir[i].from = rng() % 360;
+            this->dir[i].to = rng() % MAX_ROTATION;
         }
         init(pos, elapsed);
         this->destroy = true;
     }
 
-    bool update(uint32_t elapsed)
+    //outlines placed at (x, y) and scaled around there, appended as one path
+    static void append(Shape* shape, const Point* outline, size_t ptsCnt, const PathCommand* cmds, size_t cmdsCnt, size_t cnt, const float* x, const float* y, float scale)
+    {
+        Point pts[FLASH_GLOWS * ELLIPSE_PTS];
+        PathCommand path[FLASH_GLOWS * 6];
+
+        auto dst = pts;
+        for (size_t i = 0; i < cnt; ++i) {
+            for (size_t p = 0; p < ptsCnt; ++p, ++dst, ++outline) {
+                *dst = {x[i] + outline->x * scale, y[i] + outline->y * scale};
+            }
+            memcpy(path + i * cmdsCnt, cmds, sizeof(PathCommand) * cmdsCnt);
+        }
+
+        shape->reset();
+        shape->appendPath(path, cnt * cmdsCnt, pts, cnt * ptsCnt);
+    }
+
+    //(min, max) is the view, the explosion out of there is hidden and its paths are not rebuilt.
+    bool update(uint32_t elapsed, const Point& min, const Point& max)
     {
+        static const PathCommand ellipseCmds[] = {PathCommand::MoveTo, PathCommand::CubicTo, PathCommand::CubicTo, PathCommand::CubicTo, PathCommand::CubicTo, PathCommand::Close};
+        static const PathCommand rectCmds[] = {PathCommand::MoveTo, PathCommand::LineTo, PathCommand::LineTo, PathCommand::LineTo, PathCommand::Close};
+
         auto progress = float(elapsed - begin) / PARTICLE_TIME;
         if (progress > 1.0f) {
-            for (int i = 0; i < PARTICLE_NUM; ++i) {
-                particle[i].shape->opacity(0);
-            }
+            particles->opacity(0);
             return true;
         }
 
+        float x[PARTICLE_TOTAL], y[PARTICLE_TOTAL];
+        Point bmin = pos, bmax = pos;
+        auto tween = [&](int first, int cnt) {
+            KERNEL.tween(pos.x, tx + first, progress, x + first, cnt);
+            KERNEL.tween(pos.y, ty + first, progress, y + first, cnt);
+            for (int i = first; i < first + cnt; ++i) {
+                bmin = {std::min(bmin.x, x[i]), std::min(bmin.y, y[i])};
+                bmax = {std::max(bmax.x, x[i]), std::max(bmax.y, y[i])};
+            }
+        };
+        if (destroy) tween(0, particleCnt);
+        tween(PARTICLE_NUM, glowCnt);
+        tween(PARTICLE_NUM + FLASH_GLOWS, sparkCnt);
+
+        //the longest outline reaches 80 from its position
+        auto margin = _S(80.0f);
+        auto in = bmax.x + margin > min.x && bmin.x - margin < max.x && bmax.y + margin > min.y && bmin.y - margin < max.y;
+        if (in != shown) {
+            model->visible(in);
+            shown = in;
+        }
+        if (!in) return false;
+
         if (destroy) {
-            auto c = 255 - 255 * progress;
-            for (int i = 0; i < PARTICLE_NUM; ++i) {
-                particle[i].shape->translate(lerp(pos.x, particle[i].to.x, progress), lerp(pos.y, particle[i].to.y, progress));
-                particle[i].shape->rotate(lerp(particle[i].dir.from, particle[i].dir.to, progress));
-                particle[i].shape->scale(1.0f - 0.25f * progress);
-                particle[i].shape->opacity(c);
+            auto scale = lerp(1.0f, 0.75f, progress);
+            Point pts[PARTICLE_NUM * 4];
+            for (int i = 0; i < particleCnt; ++i) {
+                auto p = pts + i * 4;
+                p[0] = {0.0f, 0.0f};
+                p[1] = {_S(8.0f) * scale, 0.0f};
+                p[2] = {_S(8.0f) * scale, _S(60.0f) * scale};
+                p[3] = {0.0f, _S(60.0f) * scale};
+                rotate(p, 4, lerp(dir[i].from, dir[i].to, progress));
             }
+            //the rects are anchored at their origins, so they are placed at (x, y) without a scale
+            append(particles, pts, 4, rectCmds, 5, particleCnt, x, y, 1.0f);
+            particles->opacity(255 - 255 * progress);
         }
 
-        auto scale = 1.0f - (0.75f * progress);
+        auto fx = x + PARTICLE_NUM;
+        auto fy = y + PARTICLE_NUM;
+        auto scale = lerp(1.0f, 0.25f, progress);
         auto sc = uint8_t(200.0f * cos(progress));
 
-        for (int i = 0; i < PARTICLE_EXTRA / 2; ++i) {
-            flashes[i].shape->translate(lerp(pos.x, flashes[i].to.x, progress), lerp(pos.y, flashes[i].to.y, progress));
-            flashes[i].shape->fill(rand() % 255, rand() % 255, rand() % 255, sc);
-            flashes[i].shape->scale(scale);
+        auto n = glowCnt / FLASH_BUCKETS;
+        for (int i = 0; i < FLASH_BUCKETS; ++i) {
+            append(glows[i], glowPts + i * n * ELLIPSE_PTS, ELLIPSE_PTS, ellipseCmds, 6, n, fx + i * n, fy + i * n, scale);
+            glows[i]->fill(flicker() % 255, flicker() % 255, flicker() % 255, sc);
         }
 
         auto col = std::max(int(255 - 255 * progress * 2.0f), 0);
-
-        for (int i = PARTICLE_EXTRA / 2; i < PARTICLE_EXTRA; ++i) {
-            flashes[i].shape->translate(lerp(pos.x, flashes[i].to.x, progress), lerp(pos.y, flashes[i].to.y, progress));
-            flashes[i].shape->fill(255, 255, col, col);
-            flashes[i].shape->scale(scale);
-        }
+        append(sparks, sparkPts, 4, rectCmds, 5, sparkCnt, fx + FLASH_GLOWS, fy + FLASH_GLOWS, scale);
+        sparks->fill(255, 255, col, col);
 
         return false;
     }
@@ -733,27 +1716,34 @@ struct Explosion
 
 struct GarbageCollector
 {
-    Scene* elayer;
-    vector<Enemy*> enemies[4];
+    #define EXPLOSION_POOL 300
+    #define PARTICLE_BUDGET 8000    //particles shared by all the explosions in use
+
+    //The pooled models stay attached to their layers in stable slots, hidden while they are in the pool.
+    //It avoids the linear child removal of the scenes on every kill.
+    vector<Paint*> enemies[Enemy::NUM_ENEMY_TYPE];
     vector<Explosion*> explosions;
+    Scene* layers[Enemy::NUM_ENEMY_TYPE] = {};  //slots of the enemies, one layer per type
+    Scene* xlayer = nullptr;                    //slots of the explosions
+    size_t budget = PARTICLE_BUDGET;
 
     GarbageCollector()
     {
-        for (int i = 0; i < 4; ++i) {
+        for (size_t i = 0; i < Enemy::NUM_ENEMY_TYPE; ++i) {
             enemies[i].reserve(200);
         }
 
-        explosions.reserve(300);
-        for (int i = 0; i < 300; ++i) {
+        explosions.reserve(EXPLOSION_POOL);
+        for (int i = 0; i < EXPLOSION_POOL; ++i) {
             explosions.push_back(new Explosion);
         }
     }
 
     ~GarbageCollector()
     {
-        for (int i = 0; i < 4; ++i) {
+        for (size_t i = 0; i < Enemy::NUM_ENEMY_TYPE; ++i) {
             for (auto& e : enemies[i]) {
-                delete(e);
+                e->unref();
             }
         }
         for (auto& e : explosions) {
@@ -761,139 +1751,735 @@ struct GarbageCollector
         }
     }
 
-    template<class T>
-    T* get(const Point& bound, uint32_t elapsed)
+    //the enemies are grouped by type, so the consecutive paints share their fill, stroke and blending.
+    //the explosions are drawn over them.
+    void attach(Scene* elayer)
+    {
+        for (auto& layer : layers) {
+            layer = Scene::gen();
+            elayer->add(layer);
+        }
+        xlayer = Scene::gen();
+        elayer->add(xlayer);
+        for (auto e : explosions) {
+            e->model->visible(false);
+            xlayer->add(e->model);
+        }
+    }
+
+    Paint* gen(int type)
+    {
+        auto ret = Enemy::gen(type);
+        layers[type]->add(ret);
+        return ret;
+    }
+
+    Paint* get(int type)
     {
-        if (enemies[T::type].empty()) return new T(elayer, bound, elapsed);
-        auto ret = enemies[T::type].back();
-        enemies[T::type].pop_back();
-        ret->init(elayer, bound, elapsed);
-        return static_cast<T*>(ret);
+        if (enemies[type].empty()) return gen(type);
+        auto ret = enemies[type].back();
+        enemies[type].pop_back();
+        //pooled for the other rendering, the atlas has been turned on or off since
+        if ((ret->type() == tvg::Type::Picture) != ATLAS.valid()) {
+            layers[type]->remove(ret);
+            ret->unref();
+            return gen(type);
+        }
+        return ret;
     }
 
-    void retrieve(Enemy* e)
+    void retrieve(int type, Paint* model)
     {
-        enemies[e->type].push_back(e);
+        model->visible(false);
+        enemies[type].push_back(model);
     }
 
     Explosion* get()
     {
-        if (explosions.empty()) return new Explosion;
-        auto ret = explosions.back();
-        explosions.pop_back();
+        Explosion* ret;
+        if (explosions.empty()) {
+            ret = new Explosion;
+            xlayer->add(ret->model);
+        } else {
+            ret = explosions.back();
+            explosions.pop_back();
+        }
+        return ret;
+    }
+
+    //the particles of the explosions in use degrade with their number, so they stay in the budget together
+    void balance(const vector<Explosion*>& live)
+    {
+        if (live.empty()) return;
+        auto share = budget / live.size();
+        for (auto e : live) e->lod(share);
+    }
+
+    void retrieve(Explosion* e)
+    {
+        e->model->visible(false);
+        explosions.push_back(e);
+    }
+
+    void blend(BlendMethod method)
+    {
+        for (auto& pool : enemies) {
+            for (auto e : pool) Enemy::blend(e, method);
+        }
+    }
+};
+
+//Uniform grid over the enemy positions, rebuilt every frame.
+//The cell size covers the largest query range, so a query visits 3x3 cells.
+struct SpatialHash
+{
+    vector<int> heads;      //first item per cell (-1: empty)
+    vector<int> next;       //next item in the same cell
+    vector<Point> pts;
+    Point min;
+    float inv;              //1 / cell size
+    int cols, rows;
+
+    void init(const Point& min, const Point& max, float cell)
+    {
+        this->min = min;
+        inv = 1.0f / cell;
+        cols = int((max.x - min.x) * inv) + 1;
+        rows = int((max.y - min.y) * inv) + 1;
+        heads.resize(cols * rows);
+        next.reserve(1000);
+        pts.reserve(1000);
+    }
+
+    //positions outside of the grid are clamped to the border cells, distances are still exact.
+    void cell(const Point& pt, int& x, int& y)
+    {
+        x = std::clamp(int((pt.x - min.x) * inv), 0, cols - 1);
+        y = std::clamp(int((pt.y - min.y) * inv), 0, rows - 1);
+    }
+
+    void clear()
+    {
+        std::fill(heads.begin(), heads.end(), -1);
+        next.clear();
+        pts.clear();
+    }
+
+    void insert(const Point& pt)
+    {
+        int x, y;
+        cell(pt, x, y);
+        auto& head = heads[y * cols + x];
+        next.push_back(head);
+        head = int(pts.size());
+        pts.push_back(pt);
+    }
+
+    //the lowest index item within the range (squared distance) of pt, -1 if none
+    template<typename Accept>
+    int query(const Point& pt, float range, Accept accept)
+    {
+        int cx, cy;
+        cell(pt, cx, cy);
+        auto ret = -1;
+        for (int y = std::max(cy - 1, 0); y <= std::min(cy + 1, rows - 1); ++y) {
+            for (int x = std::max(cx - 1, 0); x <= std::min(cx + 1, cols - 1); ++x) {
+                for (auto i = heads[y * cols + x]; i >= 0; i = next[i]) {
+                    if ((ret < 0 || i < ret) && intersect(pt, pts[i], range) && accept(i)) ret = i;
+                }
+            }
+        }
+        return ret;
+    }
+
+    //reference brute-force path of query()
+    template<typename Accept>
+    int bruteforce(const Point& pt, float range, Accept accept)
+    {
+        for (int i = 0; i < int(pts.size()); ++i) {
+            if (intersect(pt, pts[i], range) && accept(i)) return i;
+        }
+        return -1;
+    }
+};
+
+//Printable ascii glyphs of the font at one pixel size, rendered once into a strip of cells.
+struct GlyphAtlas
+{
+    #define GLYPH_FIRST 32
+    #define GLYPH_CNT 95
+
+    struct Glyph
+    {
+        float advance;
+        float x, y;             //ink offset from the pen
+        uint32_t w, h;          //ink size
+    } glyphs[GLYPH_CNT];
+
+    uint32_t* strip = nullptr;
+    uint32_t cw = 0, ch = 0;    //cell size
+    float ascent = 0.0f, descent = 0.0f;
+    float size = 0.0f;
+    Color color;
+
+    ~GlyphAtlas()
+    {
+        free(strip);
+    }
+
+    Text* gen(const char* str)
+    {
+        auto text = Text::gen();
+        text->font(FONT_NAME);
+        text->size(size);
+        text->fill(color.r, color.g, color.b);
+        text->text(str);
+        return text;
+    }
+
+    //ink bounds of the string, false if it has no ink
+    bool bounds(const char* str, float& x, float& y, float& w, float& h)
+    {
+        auto text = gen(str);
+        text->ref();
+        auto ret = text->bounds(&x, &y, &w, &h) == Result::Success && w > 0.0f && h > 0.0f;
+        text->unref();
         return ret;
     }
 
-    void retrieve(Explosion* e)
-    {
-        explosions.push_back(e);
+    bool init(float size, const Color& color)
+    {
+        this->size = size;
+        this->color = color;
+
+        float x, y, w, h, hx, hy, hw, hh;
+        bounds("HH", hx, hy, hw, hh);
+
+        ascent = FLT_MAX;
+        descent = -FLT_MAX;
+        for (int i = 0; i < GLYPH_CNT; ++i) {
+            auto& g = glyphs[i];
+            char str[4] = {'H', char(GLYPH_FIRST + i), 'H', 0};
+            //the advance is what the glyph adds between the two references
+            g.advance = bounds(str, x, y, w, h) ? w - hw : 0.0f;
+            str[0] = char(GLYPH_FIRST + i);
+            str[1] = 0;
+            if (bounds(str, x, y, w, h)) {
+                g = {g.advance, floorf(x), floorf(y), uint32_t(ceilf(x + w) - floorf(x)), uint32_t(ceilf(y + h) - floorf(y))};
+                cw = std::max(cw, g.w);
+                ch = std::max(ch, g.h);
+                ascent = std::min(ascent, g.y);
+                descent = std::max(descent, g.y + g.h);
+            } else {
+                g = {g.advance, 0.0f, 0.0f, 0, 0};
+            }
+        }
+        if (cw == 0 || ch == 0) return false;
+
+        //cells are stacked vertically, the ink sits on the top-left of each
+        auto scene = Scene::gen();
+        for (int i = 0; i < GLYPH_CNT; ++i) {
+            auto& g = glyphs[i];
+            if (g.w == 0) continue;
+            char str[2] = {char(GLYPH_FIRST + i), 0};
+            auto text = gen(str);
+            text->translate(-g.x, float(ch * i) - g.y);
+            scene->add(text);
+        }
+        strip = rasterize(scene, cw, ch * GLYPH_CNT);
+        return strip != nullptr;
+    }
+
+    const Glyph* glyph(char c)
+    {
+        if (c < GLYPH_FIRST || c >= GLYPH_FIRST + GLYPH_CNT) return nullptr;
+        return &glyphs[c - GLYPH_FIRST];
+    }
+
+    const uint32_t* cell(char c)
+    {
+        return strip + cw * ch * (c - GLYPH_FIRST);
+    }
+};
+
+//A text composed from the glyph atlas into its own image. Transform the model as the text.
+//Falls back to a Text without the atlas.
+struct Label
+{
+    //a text composed from an atlas, it can be shown by any label
+    struct Image
+    {
+        vector<uint32_t> buffer;
+        uint32_t w = 0, h = 0;
+        float x = 0.0f, y = 0.0f;   //image offset from the pen
+    };
+
+    Scene* model;
+    Picture* picture = nullptr;
+    Text* fallback = nullptr;
+    GlyphAtlas* atlas = nullptr;
+    Image images[2];                //alternated, so that a new image is loaded on every change
+    int front = 0;
+    float ax = 0.0f, ay = 0.0f;     //alignment
+
+    void init(GlyphAtlas* atlas)
+    {
+        model = Scene::gen();
+        if (atlas->strip) {
+            this->atlas = atlas;
+            picture = Picture::gen();
+            model->add(picture);
+        } else {
+            fallback = atlas->gen("");
+            model->add(fallback);
+        }
+    }
+
+    void align(float x, float y)
+    {
+        ax = x;
+        ay = y;
+        if (fallback) fallback->align(x, y);
+    }
+
+    void text(const char* str)
+    {
+        if (fallback) {
+            fallback->text(str);
+            return;
+        }
+
+        front = 1 - front;
+        if (compose(atlas, str, images[front])) show(images[front]);
+        else picture->visible(false);
+    }
+
+    void show(const Image& image)
+    {
+        picture->load(const_cast<uint32_t*>(image.buffer.data()), image.w, image.h, ColorSpace::ARGB8888, false);
+        picture->translate(image.x - ax * image.w, image.y - ay * image.h);
+        picture->visible(true);
+    }
+
+    //blend the glyph cells of the string into the image, false if it has no ink
+    static bool compose(GlyphAtlas* atlas, const char* str, Image& image)
+    {
+        //ink extent of the string
+        auto x0 = FLT_MAX, x1 = -FLT_MAX;
+        auto pen = 0.0f;
+        for (auto p = str; *p; ++p) {
+            auto g = atlas->glyph(*p);
+            if (!g) continue;
+            if (g->w > 0) {
+                x0 = std::min(x0, pen + g->x);
+                x1 = std::max(x1, pen + g->x + g->w);
+            }
+            pen += g->advance;
+        }
+        if (x0 > x1) return false;
+
+        auto w = uint32_t(ceilf(x1 - x0));
+        auto h = uint32_t(atlas->descent - atlas->ascent);
+        auto& buffer = image.buffer;
+        buffer.assign(w * h, 0);
+
+        //blend the cells over the label
+        pen = 0.0f;
+        for (auto p = str; *p; ++p) {
+            auto g = atlas->glyph(*p);
+            if (!g) continue;
+            auto src = atlas->cell(*p);
+            auto ox = int(roundf(pen + g->x - x0));
+            auto oy = int(g->y - atlas->ascent);
+            for (uint32_t y = 0; y < g->h; ++y) {
+                auto s = src + y * atlas->cw;
+                auto d = buffer.data() + (oy + y) * w + ox;
+                for (uint32_t x = 0; x < g->w && ox + x < w; ++x) {
+                    if (s[x] == 0) continue;
+                    auto ia = 255 - (s[x] >> 24);
+                    auto dst = d[x];
+                    auto rb = (((dst & 0x00ff00ff) * ia) >> 8) & 0x00ff00ff;
+                    auto ag = (((dst >> 8) & 0x00ff00ff) * ia) & 0xff00ff00;
+                    d[x] = s[x] + rb + ag;
+                }
+            }
+            pen += g->advance;
+        }
+
+        image.w = w;
+        image.h = h;
+        image.x = x0;
+        image.y = atlas->ascent;
+        return true;
     }
 };
 
+//A fixed ring of combo texts, created and attached once. The oldest one is taken over by a new combo.
+//The texts are composed once per counter value and shared by the slots.
 struct ComboMgr
 {
     #define COMBO_TIME 750.0f
+    #define COMBO_MAX 64
+    #define COMBO_TEXTS 256     //counters with a shared composed text, the higher ones are composed by their slot
 
     struct Combo
     {
-        ComboMgr* mgr;
-        Text* text;
-        Text* combo;
+        Label label;
+        Scene* text;
         float time;
+        int counter = 0;        //counter of the composed text
+        bool active = false;
 
-        Combo(ComboMgr* mgr) : mgr(mgr), text(Text::gen())
-        {
-            text->ref();
-            text->font(FONT_NAME);
-            text->size(_S(50));
-            text->fill(170, 255, 80);
-        }
-
-        ~Combo()
+        void init(Scene* layer, GlyphAtlas* font)
         {
-            text->unref();
+            label.init(font);
+            text = label.model;
+            text->visible(false);
+            layer->add(text);
         }
 
-        void init(const Point& pos, int counter, uint32_t elapsed)
+        //image is the shared composed text, nullptr to compose it on the label
+        void init(const Point& pos, int counter, const Label::Image* image, uint32_t elapsed)
         {
-            char buf[20];
-            snprintf(buf, sizeof(buf), "%dx combo!", counter);
-            text->text(buf);
+            if (this->counter != counter) {
+                if (image) {
+                    label.show(*image);
+                } else {
+                    char buf[20];
+                    snprintf(buf, sizeof(buf), "%dx combo!", counter);
+                    label.text(buf);
+                }
+                this->counter = counter;
+            }
             text->translate(pos.x, pos.y);
-            mgr->layer->add(text);
+            text->opacity(255);
+            text->scale(1.0f);
+            text->visible(true);
             time = (float)elapsed;
+            active = true;
         }
 
-        bool update(uint32_t elapsed)
+        //the image is only transformed, no glyph is outlined again
+        void update(uint32_t elapsed)
         {
             auto progress = float(elapsed - time) / COMBO_TIME;
             if (progress <= 1.0f) {
                 text->opacity(255 - (255 * progress));
                 text->scale(1.0f + 0.2f * progress);
-                return false;
+                PROFILE_TRANSFORMS(1);
+            } else {
+                text->visible(false);
+                active = false;
             }
-            return true;
         }
     };
 
     Scene* layer;
-    list<Combo*> combos;
-    vector<Combo*> recycle;
+    GlyphAtlas* font;
+    Combo ring[COMBO_MAX];
+    Label::Image texts[COMBO_TEXTS];    //composed texts, indexed by the counter
+    size_t head = 0;            //next slot to take
     int type = -1;
     int counter = 0;
 
+#ifdef TVGDEMO_PROFILE
+    //heap allocations in the combo paths
+    struct {
+        uint64_t total = 0;
+        uint64_t second = 0;        //in the current second
+        uint32_t peak = 0;          //per second
+        uint32_t begin = 0, last = 0, now = 0;
+    } allocs;
+
     ~ComboMgr()
     {
-        for (auto& combo : combos) {
-            delete(combo);
-        }
-        for (auto& combo : recycle) {
-            delete(combo);
-        }
+        //the total and the average cover the last partial second, the peak only the complete ones
+        auto total = allocs.total + allocs.second;
+        auto secs = float(allocs.now - allocs.begin) * 0.001f;
+        fprintf(stdout, "Combo allocations: %lu total, %.1f/s average, %u/s peak\n", (unsigned long)total, secs > 0.0f ? total / secs : 0.0f, allocs.peak);
     }
+#endif
 
-    void init(Canvas* canvas)
+    void init(Canvas* canvas, GlyphAtlas* font)
     {
         layer = Scene::gen();
         canvas->add(layer);
-        recycle.reserve(10);
+        this->font = font;
+        for (auto& combo : ring) combo.init(layer, font);
+    }
+
+    //the composed text of the counter, nullptr without the atlas or past the shared ones
+    const Label::Image* text(int counter)
+    {
+        if (!font->strip || counter >= COMBO_TEXTS) return nullptr;
+        auto& image = texts[counter];
+        if (image.w == 0) {
+            char buf[20];
+            snprintf(buf, sizeof(buf), "%dx combo!", counter);
+            if (!Label::compose(font, buf, image)) return nullptr;
+        }
+        return &image;
     }
 
     int trigger(int type, const Point& pos, uint32_t elapsed)
     {
+    #ifdef TVGDEMO_PROFILE
+        auto mark = tvgdemo::allocations.load(std::memory_order_relaxed);
+    #endif
         if (this->type == type) {
             ++counter;
-            Combo* combo;
-            if (recycle.empty()) {
-                combo = new Combo(this);
-            } else {
-                combo = recycle.back();
-                recycle.pop_back();
-            }
-            combo->init(pos, counter, elapsed);            
-            combos.push_back(combo);
+            ring[head].init(pos, counter, text(counter), elapsed);
+            head = (head + 1) % COMBO_MAX;
         } else {
             this->type = type;
             counter = 1;
         }
+    #ifdef TVGDEMO_PROFILE
+        allocs.second += tvgdemo::allocations.load(std::memory_order_relaxed) - mark;
+    #endif
         return counter;
     }
 
     void update(uint32_t elapsed)
     {
-        for (auto it = combos.begin(); it != combos.end(); ) {
-            auto combo = *it;
-            if (combo->update(elapsed)) {
-                layer->remove(combo->text);
-                recycle.push_back(combo);
-                it = combos.erase(it);
-            } else {
-                ++it;
+        PROFILE_SCOPE("combo");
+
+    #ifdef TVGDEMO_PROFILE
+        auto mark = tvgdemo::allocations.load(std::memory_order_relaxed);
+    #endif
+        for (auto& combo : ring) {
+            if (combo.active) combo.update(elapsed);
+        }
+    #ifdef TVGDEMO_PROFILE
+        allocs.second += tvgdemo::allocations.load(std::memory_order_relaxed) - mark;
+        if (allocs.last == 0) allocs.begin = allocs.last = elapsed;
+        allocs.now = elapsed;
+        if (elapsed - allocs.last >= 1000) {
+            allocs.total += allocs.second;
+            allocs.peak = std::max(allocs.peak, uint32_t(allocs.second));
+            allocs.second = 0;
+            allocs.last = elapsed;
+        }
+    #endif
+    }
+};
+
+#ifdef TVGDEMO_PROFILE
+
+//live stacked bar of the profiled phases, drawn next to the fps text
+struct ProfileOverlay
+{
+    #define OVERLAY_MSEC_WIDTH _S(40)    //bar width per millisecond
+
+    Shape* bars[tvgdemo::Profiler::MAX_PHASES];
+    Text* labels[tvgdemo::Profiler::MAX_PHASES];
+    int count = 0;
+
+    void update(Canvas* canvas, bool updateLabel)
+    {
+        static const Color colors[] = {
+            {255, 80, 80}, {255, 170, 50}, {255, 255, 80}, {120, 255, 80}, {50, 200, 200}, {80, 140, 255},
+            {170, 100, 255}, {255, 100, 220}, {200, 200, 200}, {150, 90, 40}, {40, 150, 90}, {90, 40, 150}
+        };
+
+        auto& profiler = tvgdemo::profiler;
+
+        //phases are registered on their first hit
+        for (; count < profiler.count; ++count) {
+            auto& c = colors[count % (sizeof(colors) / sizeof(colors[0]))];
+            bars[count] = Shape::gen();
+            bars[count]->fill(c.r, c.g, c.b, 200);
+            canvas->add(bars[count]);
+            labels[count] = Text::gen();
+            labels[count]->font(FONT_NAME);
+            labels[count]->size(_S(14));
+            labels[count]->fill(c.r, c.g, c.b);
+            labels[count]->translate(_S(300) + _S(170) * (count % 6), _S(50) + _S(24) * (count / 6));
+            canvas->add(labels[count]);
+        }
+
+        auto x = float(_S(300));
+        for (int i = 0; i < count; ++i) {
+            auto w = float(profiler.average[i] * OVERLAY_MSEC_WIDTH);
+            bars[i]->reset();
+            bars[i]->appendRect(x, _S(15), w, _S(25));
+            x += w;
+            if (updateLabel) {
+                char buf[32];
+                snprintf(buf, sizeof(buf), "%s %.2f", profiler.names[i], profiler.average[i]);
+                labels[i]->text(buf);
             }
         }
     }
 };
 
+#endif
+
+/* Per-frame keyboard stream. Each frame is a (elapsed delta, key mask) token,
+   consecutive identical tokens are run-length encoded as varint pairs
+   (repeat count, (delta << 4) | keys) after a small header with the seed. */
+struct InputLog
+{
+    #define INPUT_MAGIC "TJIR"
+    #define INPUT_VERSION 1
+
+    enum Key : uint8_t {SHOOT = 1, LEFT = 2, RIGHT = 4, UP = 8};
+
+    const char* path = nullptr;
+    vector<uint8_t> data;
+    size_t cursor = 0;          //read position of the replay
+    uint32_t elapsed = 0;       //timestamp of the last frame
+    uint32_t token = 0;         //current (delta << 4) | keys
+    uint32_t count = 0;         //repeats of the current token
+    bool recording = false;
+    bool replaying = false;
+
+    void put(uint32_t v)
+    {
+        while (v >= 0x80) {
+            data.push_back(uint8_t(v) | 0x80);
+            v >>= 7;
+        }
+        data.push_back(uint8_t(v));
+    }
+
+    bool get(uint32_t& v)
+    {
+        v = 0;
+        for (int shift = 0; cursor < data.size() && shift < 35; shift += 7) {
+            auto b = data[cursor++];
+            v |= uint32_t(b & 0x7f) << shift;
+            if (!(b & 0x80)) return true;
+        }
+        return false;
+    }
+
+    void record(const char* path, uint32_t seed)
+    {
+        this->path = path;
+        data.assign(INPUT_MAGIC, INPUT_MAGIC + 4);
+        data.push_back(INPUT_VERSION);
+        put(seed);
+        recording = true;
+    }
+
+    bool replay(const char* path, uint32_t& seed)
+    {
+        ifstream file(path, ios::binary);
+        if (!file) {
+            cout << "Couldn't open the input recording \"" << path << "\"." << endl;
+            return false;
+        }
+        data.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+        if (data.size() < 5 || memcmp(data.data(), INPUT_MAGIC, 4) || data[4] != INPUT_VERSION) {
+            cout << "Invalid input recording \"" << path << "\"." << endl;
+            return false;
+        }
+        cursor = 5;
+        if (!get(seed)) return false;
+        replaying = true;
+        return true;
+    }
+
+    void write(uint32_t elapsed, uint8_t keys)
+    {
+        auto token = ((elapsed - this->elapsed) << 4) | keys;
+        this->elapsed = elapsed;
+        if (count > 0 && token == this->token) {
+            ++count;
+            return;
+        }
+        flush();
+        this->token = token;
+        count = 1;
+    }
+
+    bool read(uint32_t& elapsed, uint8_t& keys)
+    {
+        if (count == 0 && (!get(count) || !get(token) || count == 0)) return false;
+        --count;
+        this->elapsed += token >> 4;
+        elapsed = this->elapsed;
+        keys = token & 0x0f;
+        return true;
+    }
+
+    void flush()
+    {
+        if (count == 0) return;
+        put(count);
+        put(token);
+        count = 0;
+    }
+
+    void save()
+    {
+        if (!recording) return;
+        flush();
+        ofstream file(path, ios::binary);
+        file.write((const char*)data.data(), data.size());
+        fprintf(stdout, "Input recorded: %s (%zu bytes, %u ms)\n", path, data.size(), elapsed);
+        recording = false;
+    }
+};
+
+//Steps the visual quality down when the frame work runs over the target budget and back up with headroom.
+//The thresholds and the hold times are apart, so the tier doesn't flip back and forth around the target.
+struct Governor
+{
+    #define GOVERNOR_DOWN 0.9f      //step down above this ratio of the frame budget
+    #define GOVERNOR_UP 0.5f        //step up below this ratio of the frame budget
+    #define GOVERNOR_DOWN_HOLD 500  //ms the overload must last before a step down
+    #define GOVERNOR_UP_HOLD 3000   //ms the headroom must last before a step up
+
+    struct Tier
+    {
+        uint8_t blur;           //blur quality of the zone borders
+        bool shadow;            //drop shadows of the player, missiles and hud
+        uint8_t particles;      //particle budget shift
+        bool additive;          //additive blending of the enemies
+    };
+
+    static constexpr const Tier tiers[] = {{30, true, 0, true}, {10, true, 1, true}, {0, false, 2, true}, {0, false, 3, false}};
+    static constexpr const int TIER_CNT = sizeof(tiers) / sizeof(tiers[0]);
+
+    float budget = 0.0f;    //frame budget (ms), 0: disabled
+    float load = 0.0f;      //smoothed frame work (ms)
+    uint32_t since = 0;     //elapsed time the load crossed a threshold
+    int pending = 0;        //1: step down, -1: step up
+    int tier = 0;
+
+    void init(uint32_t fps)
+    {
+        if (fps == 0) return;
+        budget = 1000.0f / float(fps);
+        load = budget * GOVERNOR_UP;
+    }
+
+    //returns true if the tier changed
+    bool update(float busy, uint32_t elapsed)
+    {
+        if (budget == 0.0f) return false;
+
+        load += (busy - load) * 0.1f;
+
+        int step = 0;
+        if (load > budget * GOVERNOR_DOWN && tier < TIER_CNT - 1) step = 1;
+        else if (load < budget * GOVERNOR_UP && tier > 0) step = -1;
+
+        if (step != pending) {
+            pending = step;
+            since = elapsed;
+            return false;
+        }
+        if (step == 0 || elapsed - since < (step > 0 ? GOVERNOR_DOWN_HOLD : GOVERNOR_UP_HOLD)) return false;
+
+        tier += step;
+        since = elapsed;
+        return true;
+    }
+};
+
 struct ThorJanitor : tvgdemo::Demo
 {
     #define LIFE_CNT 3
@@ -902,11 +2488,20 @@ struct ThorJanitor : tvgdemo::Demo
     Player player;
     GarbageCollector gc;
     WarZone zone;
-    list<Enemy*> enemies;
-    list<Explosion*> explosions;
+    Enemies enemies;
+    vector<Explosion*> explosions;
+    Scene* world;       //camera root of the zone, the player and the enemies
     Scene* elayer;
     Shape* clipper;
     ComboMgr combo;
+    SpatialHash grid;
+    vector<uint8_t> killed;
+    InputLog log;
+    Governor governor;
+    uint8_t keys = 0;
+#ifdef TVGDEMO_PROFILE
+    ProfileOverlay overlay;
+#endif
     
     struct {
         uint32_t respawn = 0;      //elapsed time for respawn enemy
@@ -917,16 +2512,24 @@ struct ThorJanitor : tvgdemo::Demo
     struct {
         size_t count = LIFE_CNT;
         Scene* icon[LIFE_CNT];
+        EffectCache cache[LIFE_CNT];    //the icons with their drop shadows as images
         Shape* flash;
         uint32_t last = 0;
         bool active = false;
     } lives;
 
+    //hud glyphs at the pixel sizes of the fps, level, and wipes (and combo) texts
+    GlyphAtlas fonts[3];
+
     struct {
-        Text *fps, *wipes, *lv;
+        Label fps, wipes, lv;
+        Scene* wrapper;     //drop shadow of the wipes
+        EffectCache cache;  //the wipes with its drop shadow as an image
     } gui;
 
     Point origin = {_S(WIDTH/2), _S(HEIGHT/2)};
+    Point camera = {0.0f, 0.0f};    //world to screen offset
+    Point view;                     //window size, the visible area of the screen
     size_t respawnTime = 1000 - (LEVEL * RESPAWN_LEVEL);
     size_t wipesCnt = LEVEL * 100;
     bool gameplay = true;
@@ -935,10 +2538,16 @@ struct ThorJanitor : tvgdemo::Demo
 
     ~ThorJanitor()
     {
+        log.save();
+
+#ifdef TVGDEMO_PROFILE
+        fprintf(stdout, "Effect cache: %u hits, %u misses\n", EffectCache::hits, EffectCache::misses);
+#endif
+
         if (!initialized) return;
 
-        for (auto e : enemies) {
-            delete(e);
+        for (auto m : enemies.model) {
+            m->unref();
         }
         for (auto e : explosions) {
             delete(e);
@@ -952,21 +2561,47 @@ struct ThorJanitor : tvgdemo::Demo
 
     bool content(Canvas* canvas, uint32_t w, uint32_t h) override
     {
+        auto seed = tvgdemo::options.seed;
+        if (tvgdemo::options.replay) {
+            if (!log.replay(tvgdemo::options.replay, seed)) return false;
+        } else if (tvgdemo::options.record) {
+            log.record(tvgdemo::options.record, seed);
+        }
+        rng.seed(seed);
+        flicker.seed(seed);
+        view = {float(w), float(h)};
+
         Enemy::BOUND = _S(80.0f);
+        if (tvgdemo::options.atlas) ATLAS.build();
+
+        auto margin = Enemy::BOUND * 2;
+        grid.init({-margin, -margin}, {SWIDTH + margin, SHEIGHT + margin}, Enemy::BOUND * 2);
 
-        zone.init(canvas);
+        //the world layers are moved together by the camera, the zone is centered on the world origin
+        world = Scene::gen();
+        zone.init(canvas, world, w, h);
+        canvas->add(world);
 
         clipper = tvg::Shape::gen();
         clipper->appendRect(zone.min.x, zone.min.y, zone.w() + 10, zone.h() + 10);
         clipper->scale(SCALE);
+        clipper->translate(origin.x, origin.y);
 
-        player.init(canvas, {float(w) * 0.5f, float(h) * 0.5f}, (Shape*)clipper->duplicate());
+        player.init(world, {float(w) * 0.5f, float(h) * 0.5f}, (Shape*)clipper->duplicate());
 
-        gc.elayer = elayer = Scene::gen();
+        enemies.reserve(500);
+        explosions.reserve(EXPLOSION_POOL * 2);
+        elayer = Scene::gen();
         elayer->clip(clipper);
-        canvas->add(elayer);
+        world->add(elayer);
+        gc.attach(elayer);
+
+        Text::load(FONT_NAME, (const char*)FONT_DATA, sizeof(FONT_DATA));
+        fonts[0].init(_S(25), {170, 255, 80});
+        fonts[1].init(_S(40), {170, 255, 80});
+        fonts[2].init(_S(50), {170, 255, 80});
 
-        combo.init(canvas);
+        combo.init(canvas, &fonts[2]);
 
         //lives
         lives.flash = Shape::gen();
@@ -985,52 +2620,45 @@ struct ThorJanitor : tvgdemo::Demo
         pic->size(size.x, size.y);
         lives.icon[0]->translate(0, SHEIGHT - size.y);
         lives.icon[0]->add(pic);
-        canvas->add(lives.icon[0]);
 
         for (int i = 1; i < LIFE_CNT; ++i) {
             lives.icon[i] = static_cast<Scene*>(lives.icon[0]->duplicate());
             lives.icon[i]->ref();
             lives.icon[i]->translate(size.x * i, SHEIGHT - size.y);            
-            canvas->add(lives.icon[i]);
+        }
+        for (int i = 0; i < LIFE_CNT; ++i) {
+            canvas->add(lives.cache[i].init(lives.icon[i], _S(15) * 3));
+            lives.cache[i].update();
         }
 
         //gui texts - fps
-        Text::load(FONT_NAME, (const char*)FONT_DATA, sizeof(FONT_DATA));
-        gui.fps = tvg::Text::gen();
-        gui.fps->font(FONT_NAME);
-        gui.fps->size(25);
-        gui.fps->text("FPS: 0");
-        gui.fps->translate(10, 10);
-        gui.fps->fill(170, 255, 80);
-        gui.fps->scale(SCALE);
-        canvas->add(gui.fps);
+        gui.fps.init(&fonts[0]);
+        gui.fps.text("FPS: 0");
+        gui.fps.model->translate(10, 10);
+        canvas->add(gui.fps.model);
 
         //gui texts - wipes
-        auto wrapper = tvg::Scene::gen();
+        auto wrapper = gui.wrapper = tvg::Scene::gen();
         wrapper->add(SceneEffect::DropShadow, 170, 255, 80, 255, 0.0f, 0.0f, _S(20), 30);
-        gui.wipes = tvg::Text::gen();
-        gui.wipes->font(FONT_NAME);
-        gui.wipes->size(50);
-        gui.wipes->text("0 Wipes");
-        gui.wipes->fill(170, 255, 80);
-        gui.wipes->translate(SWIDTH/2, 10);
-        gui.wipes->align(0.5f, 0.0f);
-        gui.wipes->scale(SCALE);
-        wrapper->add(gui.wipes);
-        canvas->add(wrapper);
+        gui.wipes.init(&fonts[2]);
+        gui.wipes.align(0.5f, 0.0f);
+        gui.wipes.text("0 Wipes");
+        gui.wipes.model->translate(SWIDTH/2, 10);
+        wrapper->add(gui.wipes.model);
+        canvas->add(gui.cache.init(wrapper, _S(20) * 3));
+        gui.cache.update();
 
         //gui texts - level
-        gui.lv = tvg::Text::gen();
-        gui.lv->font(FONT_NAME);
-        gui.lv->size(40);
-        gui.lv->fill(170, 255, 80);
-        gui.lv->translate(SWIDTH -_S(20), _S(20));
-        gui.lv->align(1.0f, 0.0f);
-        gui.lv->scale(SCALE);
+        gui.lv.init(&fonts[1]);
+        gui.lv.align(1.0f, 0.0f);
+        gui.lv.model->translate(SWIDTH -_S(20), _S(20));
         char buf[30];
         snprintf(buf, sizeof(buf), "Level %ld", LEVEL + 1);
-        gui.lv->text(buf);
-        canvas->add(gui.lv);
+        gui.lv.text(buf);
+        canvas->add(gui.lv.model);
+
+        //the quality is held fixed for the reproducible runs
+        if (tvgdemo::options.step == 0 && !tvgdemo::options.replay) governor.init(tvgdemo::options.target);
 
         initialized = true;
 
@@ -1039,28 +2667,42 @@ struct ThorJanitor : tvgdemo::Demo
 
     void updateGUI(bool updateFPS)
     {
+        PROFILE_SCOPE("gui");
+
         char buf[13];
 
         //update wipes count
         if (updatedWipes) {
             snprintf(buf, sizeof(buf), "%ld Wipes", wipesCnt);
-            gui.wipes->text(buf);
+            gui.wipes.text(buf);
+            gui.cache.invalidate();
             updatedWipes = false;
         }
+        gui.cache.update();
+        for (auto& c : lives.cache) c.update();
         // update fps after a certan elapsed time, 
         // otherwise it's difficult to read if text is changed every frame.
         if (updateFPS) {
             snprintf(buf, sizeof(buf), "FPS: %d", tvgdemo::Demo::fps);
-            gui.fps->text(buf);
+            gui.fps.text(buf);
         }
     }
 
-    void destroy(Enemy* e, const Point& direction, uint32_t elapsed)
+    void destroy(size_t e, const Point& direction, uint32_t elapsed)
     {
         auto exp = gc.get();
-        exp->init(e->pos.cur, direction, e->color(), elapsed);
+        exp->init(enemies.cur(e), direction, Enemy::color(enemies.type[e]), elapsed);
         explosions.push_back(exp);
-        elayer->add(exp->model);
+    }
+
+    Point toScreen(const Point& pos) const
+    {
+        return pos + camera;
+    }
+
+    Point toWorld(const Point& pos) const
+    {
+        return pos - camera;
     }
 
     void destroy(const Point& pos, uint32_t elapsed)
@@ -1068,29 +2710,42 @@ struct ThorJanitor : tvgdemo::Demo
         auto exp = gc.get();
         exp->init(pos, elapsed);
         explosions.push_back(exp);
-        elayer->add(exp->model);
     }
 
-    void input(Canvas* canvas, uint32_t elapsed)
+    uint8_t keyboard()
     {
-        player.shoot = false;
+        uint8_t keys = 0;
 
         const Uint8 *keystate = SDL_GetKeyboardState(NULL);
         if (keystate) {
-            auto diff = elapsed - tick.last;
-            if (keystate[SDL_SCANCODE_A]) player.shoot = true;
-            if (keystate[SDL_SCANCODE_RIGHT]) player.right(diff);
-            if (keystate[SDL_SCANCODE_LEFT]) player.left(diff);
-            if (keystate[SDL_SCANCODE_UP]) player.forward(zone, diff);
+            if (keystate[SDL_SCANCODE_A]) keys |= InputLog::SHOOT;
+            if (keystate[SDL_SCANCODE_RIGHT]) keys |= InputLog::RIGHT;
+            if (keystate[SDL_SCANCODE_LEFT]) keys |= InputLog::LEFT;
+            if (keystate[SDL_SCANCODE_UP]) keys |= InputLog::UP;
         }
+        return keys;
+    }
+
+    void input(Canvas* canvas, uint32_t elapsed)
+    {
+        PROFILE_SCOPE("input");
+
+        player.shoot = false;
+
+        auto diff = elapsed - tick.last;
+        if (keys & InputLog::SHOOT) player.shoot = true;
+        if (keys & InputLog::RIGHT) player.right(diff);
+        if (keys & InputLog::LEFT) player.left(diff);
+        if (keys & InputLog::UP) player.forward(zone, diff);
     }
 
     void gamelevel()
     {
         if (LEVEL < 9 && wipesCnt / 100 > LEVEL) {
+            TRACE_EVENT("gamelevel");
             char buf[30];
             snprintf(buf, sizeof(buf), "Level %ld", ++LEVEL + 1);
-            gui.lv->text(buf);
+            gui.lv.text(buf);
             respawnTime -= RESPAWN_LEVEL;
             Enemy::DURATION -= ENEMY_DURATION_LEVEL;
         }
@@ -1098,31 +2753,62 @@ struct ThorJanitor : tvgdemo::Demo
 
     void dead(Canvas* canvas, uint32_t elapsed)
     {
+        TRACE_EVENT("dead");
+
         gameplay = false;
-        for (auto e : enemies) {
-            destroy(e, player.direction, elapsed);
-            elayer->remove(e->model);
-            gc.retrieve(e);
+        for (size_t i = 0; i < enemies.size(); ++i) {
+            destroy(i, player.direction, elapsed);
+            gc.retrieve(enemies.type[i], enemies.model[i]);
         }
         enemies.clear();
 
         if (lives.count > 0 && elapsed - lives.last > 1000) {
             --lives.count;
-            canvas->remove(lives.icon[lives.count]);
+            canvas->remove(lives.cache[lives.count].slot);
             lives.last = elapsed;
             lives.active = true;
             canvas->add(lives.flash);
         }
 
-        for (auto& fire : player.launcher.missles) {
-            player.launcher.actives = 0;
-            fire.inactivate();
-        }
+        player.launcher.clear();
+        player.launcher.render();
 
         player.model->visible(false);
         tick.end = elapsed;
     }
 
+    void quality(int tier)
+    {
+        TRACE_EVENT("quality");
+
+        auto& q = Governor::tiers[tier];
+
+        zone.blur(q.blur);
+
+        player.shadow = q.shadow;
+        player.launcher.shadow(q.shadow);
+        gui.wrapper->add(SceneEffect::Clear);
+        if (q.shadow) gui.wrapper->add(SceneEffect::DropShadow, 170, 255, 80, 255, 0.0f, 0.0f, _S(20), 30);
+        gui.cache.invalidate();
+        for (int i = 0; i < LIFE_CNT; ++i) {
+            lives.icon[i]->add(SceneEffect::Clear);
+            if (q.shadow) lives.icon[i]->add(SceneEffect::DropShadow, 170, 255, 80, 255, 0.0f, 0.0f, _S(15), 30);
+            lives.cache[i].invalidate();
+        }
+
+        gc.budget = PARTICLE_BUDGET >> q.particles;
+
+        Enemy::BLEND = q.additive ? BlendMethod::Add : BlendMethod::Normal;
+        for (auto m : enemies.model) Enemy::blend(m, Enemy::BLEND);
+        gc.blend(Enemy::BLEND);
+    }
+
+    void resize(Canvas* canvas, uint32_t w, uint32_t h) override
+    {
+        view = {float(w), float(h)};
+        zone.resize(w, h);
+    }
+
     void reset(Canvas* canvas, uint32_t elapsed)
     {
         if (elapsed - tick.end < (lives.count == 0 ? 3000 : 1000)) return;
@@ -1141,12 +2827,12 @@ struct ThorJanitor : tvgdemo::Demo
 
             lives.count = LIFE_CNT;
             for (int i = 0; i < LIFE_CNT; i++) {
-                canvas->add(lives.icon[i]);
+                canvas->add(lives.cache[i].slot);
             }
 
             char buf[30];
             snprintf(buf, sizeof(buf), "Level %ld", LEVEL + 1);
-            gui.lv->text(buf);
+            gui.lv.text(buf);
         }
 
         player.model->visible(true);
@@ -1157,13 +2843,31 @@ struct ThorJanitor : tvgdemo::Demo
 
     bool update(Canvas* canvas, uint32_t elapsed) override
     {
-        auto shift = origin - (player.pos - origin);
+        //the replay drives both the clock and the keys
+        if (log.replaying) {
+            if (!log.read(elapsed, keys)) {
+                fprintf(stdout, "Input replay finished: %u ms\n", log.elapsed);
+                quit = true;
+                return false;
+            }
+        } else {
+            keys = keyboard();
+            if (log.recording) log.write(elapsed, keys);
+        }
+
+        if (governor.update(busy, elapsed)) quality(governor.tier);
+
+        //zone offset on the screen before the move, the projectiles hit its walls
+        auto walls = origin + (origin - player.pos);
+        if (gameplay) input(canvas, elapsed);
+
+        //the player stays around the screen center while the world moves the other way, one transform for all
+        camera = origin - player.pos;
+        world->translate(camera.x, camera.y);
+        PROFILE_TRANSFORMS(1);
 
         if (gameplay) {
-            input(canvas, elapsed);
-            player.update(elapsed, shift);
-            zone.update(shift);
-            clipper->translate(shift.x, shift.y);
+            player.update(elapsed, camera);
         } else {
             //player dead flash effect
             if (lives.active) {
@@ -1177,91 +2881,408 @@ struct ThorJanitor : tvgdemo::Demo
             }
             reset(canvas, elapsed);
         }
+        zone.update(origin);
 
-        auto p2o = origin - player.pos;
-        elayer->translate(p2o.x, p2o.y);
+        //visible area in the world
+        auto vmin = toWorld({0.0f, 0.0f});
+        auto vmax = toWorld(view);
 
         //enemies
         if (gameplay) {
-            Point target;
-            auto range = pow(player.bound + Enemy::BOUND, 2);
-            for (auto it = enemies.begin(); it != enemies.end(); ) {
-                auto e = *it;
-                //collide with the player
-                if (intersect(player.pos, e->pos.cur + p2o, range)) {
-                    dead(canvas, elapsed);
-                    break;
-                //update enemies
-                } else if (auto ret = e->update(elapsed, player.launcher, p2o, target)) {
-                    if (ret == 2) {  //hit by missle
-                        wipesCnt += combo.trigger(e->type, target, elapsed);
-                        updatedWipes = true;
-                        destroy(e, player.direction, elapsed);
-                        gamelevel();
-                    }
-                    elayer->remove(e->model);
-                    gc.retrieve(e);
-                    it = enemies.erase(it);
-                } else {
-                    ++it;
+            PROFILE_SCOPE("enemies");
+
+            //update enemies
+            enemies.update(elapsed);
+            for (auto i = enemies.size(); i-- > 0; ) {
+                if (enemies.done[i]) retire(i);
+            }
+
+            grid.clear();
+            for (size_t i = 0; i < enemies.size(); ++i) {
+                grid.insert(enemies.cur(i));
+            }
+
+            //collide with the player
+            if (collide(toWorld(player.pos), pow(player.bound + Enemy::BOUND, 2), [](int) { return true; }) >= 0) {
+                dead(canvas, elapsed);
+            //hit by missles
+            } else if (player.launcher.actives > 0) {
+                killed.assign(enemies.size(), 0);
+                auto range = pow(Enemy::BOUND + Enemy::BOUND, 2);
+                auto& launcher = player.launcher;
+                for (size_t m = 0; m < launcher.size(); ++m) {
+                    if (!launcher.alive[m]) continue;
+                    auto idx = collide(toWorld({launcher.x[m], launcher.y[m]}), range, [&](int i) { return !killed[i]; });
+                    if (idx < 0) continue;
+                    killed[idx] = 1;
+                    launcher.kill(m);
+                    wipesCnt += combo.trigger(enemies.type[idx], toScreen(enemies.cur(idx)), elapsed);
+                    updatedWipes = true;
+                    destroy(idx, player.direction, elapsed);
+                    gamelevel();
+                }
+                for (auto i = enemies.size(); i-- > 0; ) {
+                    if (killed[i]) retire(i);
                 }
             }
+            enemies.cull(vmin, vmax);
+            enemies.transform();
         }
 
         //hit walls
-        for (auto& fire : player.launcher.missles) {
-            if (!fire.active) continue;
-            if (fire.cur.x < _S(zone.min.x) + shift.x || fire.cur.x > _S(zone.max.x) + shift.x ||
-                fire.cur.y < _S(zone.min.y) + shift.y || fire.cur.y > _S(zone.max.y) + shift.y) {
-                destroy(fire.cur - p2o, elapsed);
-                fire.inactivate();
+        {
+            PROFILE_SCOPE("walls");
+            auto& launcher = player.launcher;
+            auto out = launcher.outside(_S(zone.min.x) + walls.x, _S(zone.min.y) + walls.y, _S(zone.max.x) + walls.x, _S(zone.max.y) + walls.y);
+            for (size_t i = 0; i < launcher.size(); ++i) {
+                if (!out[i] || !launcher.alive[i]) continue;
+                destroy(toWorld({launcher.x[i], launcher.y[i]}), elapsed);
+                launcher.kill(i);
             }
+            launcher.render();
         }
 
         //explosions
-        for (auto it = explosions.begin(); it != explosions.end(); ) {
-            auto e = *it;
-            if (e->update(elapsed)) {
-                gc.retrieve(e);
-                elayer->remove(e->model);
-                it = explosions.erase(it);
-                continue;
+        {
+            PROFILE_SCOPE("explosions");
+            gc.balance(explosions);
+            for (size_t i = 0; i < explosions.size(); ) {
+                auto e = explosions[i];
+                if (e->update(elapsed, vmin, vmax)) {
+                    gc.retrieve(e);
+                    swapRemove(explosions, i);
+                    continue;
+                }
+                ++i;
             }
-            ++it;
         }
 
         combo.update(elapsed);
 
-        updateGUI(respawn(elapsed));
+        auto updateFPS = respawn(elapsed);
+        updateGUI(updateFPS);
+
+#ifdef TVGDEMO_PROFILE
+        overlay.update(canvas, updateFPS);
+#endif
 
-        canvas->update();
+        {
+            PROFILE_SCOPE("canvas");
+            canvas->update();
+        }
 
         tick.last = elapsed;
 
         return true;
     }
 
+    void retire(size_t i)
+    {
+        gc.retrieve(enemies.type[i], enemies.model[i]);
+        enemies.remove(i);
+    }
+
+    //grid query on the enemies, cross checked with the brute-force path on demand
+    template<typename Accept>
+    int collide(const Point& pt, float range, Accept accept)
+    {
+        auto idx = grid.query(pt, range, accept);
+        if (tvgdemo::options.crosscheck) {
+            auto ref = grid.bruteforce(pt, range, accept);
+            if (idx != ref) fprintf(stderr, "Collision mismatch at (%.1f, %.1f): grid %d, brute-force %d\n", pt.x, pt.y, idx, ref);
+        }
+        return idx;
+    }
+
     bool respawn(uint32_t elapsed)
     {
+        PROFILE_SCOPE("respawn");
+
         if (!gameplay || elapsed - tick.respawn < respawnTime) return false;
         tick.respawn = elapsed;
-        Point bound = {_S(800), _S(500)};
+        TRACE_EVENT("respawn");
 
         //random enemy respawn
-        if (rand() % 2) enemies.push_back(gc.get<Boxer>(bound, elapsed));
-        if (rand() % 2) enemies.push_back(gc.get<Tripod>(bound, elapsed));
-        if (rand() % 2) enemies.push_back(gc.get<Sander>(bound, elapsed));
-        if (rand() % 2) enemies.push_back(gc.get<Hexen>(bound, elapsed));
+        for (int type = 0; type < int(Enemy::NUM_ENEMY_TYPE); ++type) {
+            if (rng() % 2 == 0) continue;
+            auto model = gc.get(type);
+            enemies.spawn(type, model, elapsed);
+        }
 
         return true;
     }
 };
 
+/************************************************************************/
+/* Microbenchmarks                                                      */
+/************************************************************************/
+
+template<typename Func>
+static double measure(Func func, int reps)
+{
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < reps; ++i) func(i);
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+}
+
+//tween of 4096 enemies: the former per-object scalar path against the batch kernels
+static void benchKernels()
+{
+    const size_t N = 4096;
+    const int REPS = 5000;
+
+    struct Legacy {
+        struct { Point from, to, cur; } pos;
+        struct { float from, to; } dir;
+        float rot;
+        uint32_t at;
+        float duration;
+    };
+
+    vector<Legacy> legacy(N);
+    vector<uint32_t> at(N);
+    vector<float> duration(N), fx(N), fy(N), tx(N), ty(N), rfrom(N), rto(N), t(N), cx(N), cy(N), rot(N);
+
+    for (size_t i = 0; i < N; ++i) {
+        at[i] = rng() % 1000;
+        duration[i] = float(Enemy::BASETIME + rng() % 1000);
+        fx[i] = float(rng() % 2000); fy[i] = float(rng() % 2000);
+        tx[i] = float(rng() % 2000); ty[i] = float(rng() % 2000);
+        rfrom[i] = float(rng() % 360); rto[i] = float(rng() % 7200);
+        legacy[i] = {{{fx[i], fy[i]}, {tx[i], ty[i]}, {}}, {rfrom[i], rto[i]}, 0.0f, at[i], duration[i]};
+    }
+
+    auto checksum = 0.0f;
+
+    auto base = measure([&](int rep) {
+        auto elapsed = uint32_t(1000 + rep);
+        for (auto& e : legacy) {
+            auto progress = float(elapsed - e.at) / e.duration;
+            e.pos.cur = {lerp(e.pos.from.x, e.pos.to.x, progress), lerp(e.pos.from.y, e.pos.to.y, progress)};
+            e.rot = lerp(e.dir.from, e.dir.to, progress);
+        }
+        checksum += legacy[rep % N].pos.cur.x;
+    }, REPS);
+
+    printf("%-10s %10.3f ms %8.3f ns/enemy %6.2fx\n", "legacy", base, base * 1e6 / (double(N) * REPS), 1.0);
+
+    auto run = [&](const Kernels& k) {
+        auto time = measure([&](int rep) {
+            auto elapsed = uint32_t(1000 + rep);
+            k.progress(at.data(), duration.data(), elapsed, t.data(), N);
+            k.lerp(fx.data(), tx.data(), t.data(), cx.data(), N);
+            k.lerp(fy.data(), ty.data(), t.data(), cy.data(), N);
+            k.lerp(rfrom.data(), rto.data(), t.data(), rot.data(), N);
+            checksum += cx[rep % N];
+        }, REPS);
+        printf("%-10s %10.3f ms %8.3f ns/enemy %6.2fx\n", k.name, time, time * 1e6 / (double(N) * REPS), base / time);
+    };
+
+    run(SCALAR_KERNELS);
+#ifdef KERNEL_X86
+    run({"sse2", progressSSE2, lerpSSE2, tweenSSE2});
+    if (__builtin_cpu_supports("avx2")) run({"avx2", progressAVX2, lerpAVX2, tweenAVX2});
+#elif defined(KERNEL_NEON)
+    run({"neon", progressNEON, lerpNEON, tweenNEON});
+#endif
+
+    printf("dispatched: %s (checksum %f)\n", KERNEL.name, checksum);
+}
+
+//rasterization of 300 rotating enemies: the stroked and the outlined vector shapes against the atlas images
+static void benchAtlas()
+{
+    const int N = 300;
+    const int FRAMES = 300;
+
+    tvg::Initializer::init(4);
+
+    auto buffer = (uint32_t*)malloc(SWIDTH * SHEIGHT * sizeof(uint32_t));
+    auto base = 0.0;
+
+    auto run = [&](const char* name, bool stroked) {
+        auto canvas = SwCanvas::gen();
+        canvas->target(buffer, SWIDTH, SWIDTH, SHEIGHT, ColorSpace::ARGB8888);
+
+        rng.seed(1);
+        Enemies enemies;
+        for (int i = 0; i < N; ++i) {
+            auto type = i % Enemy::NUM_ENEMY_TYPE;
+            Paint* model;
+            if (stroked) {
+                model = Enemy::shape(type);
+                model->blend(Enemy::BLEND);
+                model->ref();
+            } else {
+                model = Enemy::gen(type);
+            }
+            canvas->add(model);
+            enemies.spawn(type, model, 0);
+            enemies.cx[i] = float(rng() % SWIDTH);
+            enemies.cy[i] = float(rng() % SHEIGHT);
+        }
+
+        auto time = measure([&](int rep) {
+            for (int i = 0; i < N; ++i) enemies.rot[i] += 1.7f;
+            enemies.transform();
+            canvas->update();
+            canvas->draw(true);
+            canvas->sync();
+        }, FRAMES);
+
+        if (base == 0.0) base = time;
+        printf("%-10s %10.3f ms %8.3f ms/frame %6.2fx\n", name, time, time / FRAMES, base / time);
+
+        delete(canvas);
+        for (auto m : enemies.model) m->unref();
+    };
+
+    run("stroked", true);
+    run("outlined", false);
+
+    auto begin = std::chrono::steady_clock::now();
+    if (!ATLAS.build()) {
+        printf("atlas: no software engine for the offscreen\n");
+    } else {
+        printf("atlas: %u frames of %upx per type, built in %.3f ms\n", ATLAS_STEPS, ATLAS.size, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count());
+        run("atlas", false);
+    }
+
+    free(buffer);
+    tvg::Initializer::term();
+}
+
+//400 entities killed and respawned: scene add/remove against persistent slots toggled by visible()
+static void benchChurn()
+{
+    const int N = 400;
+    const int REPS = 500;
+
+    tvg::Initializer::init(4);
+
+    uint32_t buffer[64 * 64];
+    auto base = 0.0;
+
+    auto run = [&](const char* name, bool slots) {
+        auto canvas = SwCanvas::gen();
+        canvas->target(buffer, 64, 64, 64, ColorSpace::ARGB8888);
+        auto layer = Scene::gen();
+        canvas->add(layer);
+
+        vector<Paint*> models;
+        for (int i = 0; i < N; ++i) {
+            auto model = Enemy::shape(i % Enemy::NUM_ENEMY_TYPE);
+            model->ref();
+            layer->add(model);
+            models.push_back(model);
+        }
+
+        auto time = measure([&](int rep) {
+            //mass kill in the spawn order, then respawn
+            for (auto m : models) {
+                if (slots) m->visible(false);
+                else layer->remove(m);
+            }
+            canvas->update();
+            for (auto m : models) {
+                if (slots) m->visible(true);
+                else layer->add(m);
+            }
+            canvas->update();
+        }, REPS);
+
+        if (base == 0.0) base = time;
+        printf("%-10s %10.3f ms %8.3f us/entity %6.2fx\n", name, time, time * 1e3 / (double(N) * REPS), base / time);
+
+        delete(canvas);
+        for (auto m : models) m->unref();
+    };
+
+    run("add/remove", false);
+    run("slots", true);
+
+    tvg::Initializer::term();
+}
+
+//draw of 300 rotating enemies at peak load: interleaved in the spawn order against grouped per type
+static void benchLayers()
+{
+    const int N = 300;
+    const int FRAMES = 300;
+
+    tvg::Initializer::init(4);
+
+    auto buffer = (uint32_t*)malloc(SWIDTH * SHEIGHT * sizeof(uint32_t));
+    auto base = 0.0;
+
+    auto run = [&](const char* name, bool grouped) {
+        auto canvas = SwCanvas::gen();
+        canvas->target(buffer, SWIDTH, SWIDTH, SHEIGHT, ColorSpace::ARGB8888);
+
+        auto elayer = Scene::gen();
+        canvas->add(elayer);
+        Scene* layers[Enemy::NUM_ENEMY_TYPE];
+        for (auto& layer : layers) {
+            layer = grouped ? Scene::gen() : elayer;
+            if (grouped) elayer->add(layer);
+        }
+
+        rng.seed(1);
+        Enemies enemies;
+        for (int i = 0; i < N; ++i) {
+            auto type = i % Enemy::NUM_ENEMY_TYPE;
+            //the vector models, whether the atlas has been built or not
+            auto model = Enemy::outlined(type);
+            Enemy::blend(model, Enemy::BLEND);
+            model->ref();
+            layers[type]->add(model);
+            enemies.spawn(type, model, 0);
+            enemies.cx[i] = float(rng() % SWIDTH);
+            enemies.cy[i] = float(rng() % SHEIGHT);
+        }
+
+        //the draw alone, the transforms are updated out of the measure
+        double time = 0.0;
+        for (int f = 0; f < FRAMES; ++f) {
+            for (int i = 0; i < N; ++i) enemies.rot[i] += 1.7f;
+            enemies.transform();
+            canvas->update();
+            time += measure([&](int rep) {
+                canvas->draw(true);
+                canvas->sync();
+            }, 1);
+        }
+
+        if (base == 0.0) base = time;
+        printf("%-12s %10.3f ms %8.3f ms/frame %6.2fx\n", name, time, time / FRAMES, base / time);
+
+        delete(canvas);
+        for (auto m : enemies.model) m->unref();
+    };
+
+    run("interleaved", false);
+    run("per type", true);
+
+    free(buffer);
+    tvg::Initializer::term();
+}
+
+static int benchmark(const char* name)
+{
+    if (!name || !strcmp(name, "kernels")) benchKernels();
+    if (!name || !strcmp(name, "atlas")) benchAtlas();
+    if (!name || !strcmp(name, "churn")) benchChurn();
+    if (!name || !strcmp(name, "layers")) benchLayers();
+    return 0;
+}
+
 int main(int argc, char** argv)
 {
     SCALE = 0.5333333333333f;  //must be.
     SWIDTH = WIDTH * SCALE;
     SHEIGHT = HEIGHT * SCALE;
 
+    if (argc > 1 && !strcmp(argv[1], "bench")) return benchmark(argc > 2 ? argv[2] : nullptr);
+
     return tvgdemo::main(new ThorJanitor, argc, argv, false, SWIDTH, SHEIGHT, 4);
 }